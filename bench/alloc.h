@@ -0,0 +1,7 @@
+#ifndef ALLOC_H_
+#define ALLOC_H_
+
+/* Heap allocations made anywhere in the process so far, linking alloc.c in is enough to count them. */
+unsigned long allocations_count(void);
+
+#endif // ALLOC_H_
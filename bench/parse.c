@@ -0,0 +1,171 @@
+/*
+ * Parser throughput benchmark. Runs the lines dwl writes on a focus change through the old to_delimiter based
+ * parsing, kept here as the baseline, and through parse.c, reporting lines/sec and allocations per line for both.
+ */
+#include "alloc.h"
+#include "parse.h"
+#include "util.h"
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PARSE_TAGS 9
+
+static uint64_t baseline_parse(const char *line);
+static char **corpus_create(int monitors, int *length);
+static uint64_t current_parse(const char *line);
+static void parser_run(const char *name, uint64_t (*parse)(const char *line), char **lines, int length, int rounds);
+
+static const char *monitor_names[] = { "DP-1", "DP-2", "HDMI-A-1", "eDP-1", "DP-3", "DP-4", "HDMI-A-2", "DVI-D-1" };
+
+/* Summed into by both parsers, so they can be checked to agree and nothing is optimised away. */
+static uint64_t checksum;
+
+/* What stdin_handle did before parse.c, minus touching the bar. */
+uint64_t baseline_parse(const char *line) {
+    char *name, *command;
+    unsigned long loc = 0;
+    uint64_t sum = 0;
+
+    name = to_delimiter(line, &loc, ' ');
+    command = to_delimiter(line, &loc, ' ');
+    sum += strlen(name);
+    free(name);
+
+    if (STRING_EQUAL(command, "title") || STRING_EQUAL(command, "appid") || STRING_EQUAL(command, "layout")) {
+        char *text = to_delimiter(line, &loc, '\n');
+        sum += strlen(text);
+        free(text);
+    } else if (STRING_EQUAL(command, "floating") || STRING_EQUAL(command, "fullscreen") || STRING_EQUAL(command, "selmon")) {
+        char *value = to_delimiter(line, &loc, '\n');
+        sum += atoi(value);
+        free(value);
+    } else if (STRING_EQUAL(command, "tags")) {
+        for (int i = 0; i < 4; i++) {
+            char *value = to_delimiter(line, &loc, ' ');
+            sum += atoi(value);
+            free(value);
+        }
+    }
+
+    free(command);
+    return sum;
+}
+
+/* One focus change as dwl reports it: every line for every monitor, without newlines as the LineReader hands them over. */
+char **corpus_create(int monitors, int *length) {
+    static const char *titles[] = {
+        "nvim ~/src/dwl-bar/src/main.c",
+        "Mozilla Firefox — Performance analysis of Wayland status bars",
+        "alacritty",
+        "",
+    };
+    char **lines = ecalloc(monitors * 7, sizeof(*lines));
+    int n = 0;
+
+    for (int i = 0; i < monitors; i++) {
+        const char *name = monitor_names[i % LENGTH(monitor_names)];
+        lines[n++] = string_create("%s title %s", name, titles[i % LENGTH(titles)]);
+        lines[n++] = string_create("%s appid %s", name, i % 2 ? "firefox" : "Alacritty");
+        lines[n++] = string_create("%s fullscreen %d", name, 0);
+        lines[n++] = string_create("%s floating %d", name, i % 3 == 0);
+        lines[n++] = string_create("%s selmon %d", name, i == 0);
+        lines[n++] = string_create("%s tags %u %u %u %u", name, 0x1ffu >> i, 1u << (i % PARSE_TAGS), 1u << (i % PARSE_TAGS), 0u);
+        lines[n++] = string_create("%s layout %s", name, "[]=");
+    }
+
+    *length = n;
+    return lines;
+}
+
+uint64_t current_parse(const char *line) {
+    struct ParsedLine parsed;
+    uint64_t sum = 0;
+
+    if (parse_dwl_line(line, &parsed) < 0)
+        return 0;
+
+    sum += parsed.monitor.length;
+    switch (parsed.command) {
+        case Command_Title:
+        case Command_Appid:
+        case Command_Layout:
+            sum += strlen(parsed.text);
+            break;
+        case Command_Floating:
+        case Command_Fullscreen:
+        case Command_Selmon:
+            sum += parsed.value;
+            break;
+        case Command_Tags:
+            sum += parsed.occupied + parsed.tags + parsed.clients + parsed.urgent;
+            break;
+        default:
+            break;
+    }
+
+    return sum;
+}
+
+void panic(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "[bench-parse] panic: ");
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(EXIT_FAILURE);
+}
+
+void parser_run(const char *name, uint64_t (*parse)(const char *line), char **lines, int length, int rounds) {
+    struct timespec start, end;
+    unsigned long allocations = allocations_count();
+
+    checksum = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int round = 0; round < rounds; round++)
+        for (int i = 0; i < length; i++)
+            checksum += parse(lines[i]);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    allocations = allocations_count() - allocations;
+    double total = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double parsed = (double)length * rounds;
+    printf("%-8s %10.0f lines %12.0f lines/s %8.1f ns/line %6.2f allocs/line   checksum %lu\n",
+            name, parsed, parsed / total, total * 1e9 / parsed, allocations / parsed, (unsigned long)checksum);
+}
+
+int main(int argc, char *argv[]) {
+    int opt, rounds = 200000, monitors = 4, length;
+
+    while((opt = getopt(argc, argv, "n:m:h")) != -1) {
+        switch (opt) {
+            case 'n':
+                rounds = atoi(optarg);
+                break;
+            case 'm':
+                monitors = atoi(optarg);
+                break;
+            case 'h':
+            default:
+                printf("Usage: %s [-n focus changes] [-m monitors]\n", argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    if (rounds <= 0 || monitors <= 0)
+        panic("Focus changes and monitors must be positive");
+
+    char **lines = corpus_create(monitors, &length);
+    parser_run("baseline", baseline_parse, lines, length, rounds);
+    parser_run("current", current_parse, lines, length, rounds);
+
+    for (int i = 0; i < length; i++)
+        free(lines[i]);
+    free(lines);
+
+    return EXIT_SUCCESS;
+}
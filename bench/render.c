@@ -0,0 +1,217 @@
+/*
+ * Headless render benchmark. Drives a Pipeline and Bar into plain memory, no compositor needed,
+ * replaying synthetic workloads and reporting how long frames take and how much they allocate.
+ */
+#include "alloc.h"
+#include "bar.h"
+#include "main.h"
+#include "render.h"
+#include "shm.h"
+#include "util.h"
+#include <errno.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+enum Workload {
+    Workload_Status, /* A new status every frame, like a clock with seconds */
+    Workload_Title,  /* Focus moving between more windows than the layout cache holds */
+    Workload_Tags,   /* Switching tags and clients moving around */
+    Workload_UTF8,   /* Long multi-byte titles that always need ellipsizing */
+    Workload_All,
+    Workload_Last,
+};
+
+static int frame_cmp(const void *left, const void *right);
+static void ppm_write(const char *directory, const char *workload, int frame, struct Shm *shm);
+static void workload_step(enum Workload workload, struct Bar *bar, int frame);
+static void workload_run(enum Workload workload, int frames, int width, int height, int transient, const char *ppm_directory);
+
+/* Unused here, but render.c and shm.c expect them to exist. */
+struct wl_compositor *compositor;
+struct zwlr_layer_shell_v1 *shell;
+struct wl_shm *shm;
+
+static const char *workload_names[] = {
+    [Workload_Status] = "status",
+    [Workload_Title] = "title",
+    [Workload_Tags] = "tags",
+    [Workload_UTF8] = "utf8",
+    [Workload_All] = "all",
+};
+
+static const char *utf8_titles[] = {
+    "Ελληνικά κείμενα και αναφορές για την απόδοση του γραφικού περιβάλλοντος — τελικό σχέδιο",
+    "日本語のウィンドウタイトルはとても長くなることがあるので省略記号が必要になります",
+    "Ünïcödé çömbïnïng märks ánd émóji 🚀🔥✨ in a very long browser tab title",
+    "Русский текст: производительность отрисовки панели на нескольких мониторах одновременно",
+};
+
+int frame_cmp(const void *left, const void *right) {
+    uint64_t l = *(const uint64_t*)left, r = *(const uint64_t*)right;
+    return (l > r) - (l < r);
+}
+
+void panic(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "[bench-render] panic: ");
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(EXIT_FAILURE);
+}
+
+/* Writes the latest frame as a binary PPM, the buffer is XRGB8888 so every pixel is B, G, R, X in memory. */
+void ppm_write(const char *directory, const char *workload, int frame, struct Shm *shm) {
+    if (!shm->previous)
+        return;
+
+    char *path = string_create("%s/%s-%05d.ppm", directory, workload, frame);
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        panic("fopen %s", path);
+
+    fprintf(file, "P6\n%d %d\n255\n", shm->width, shm->height);
+    const uint8_t *row = shm->previous->buffer_ptr;
+    for (int y = 0; y < shm->height; y++, row += shm->stride) {
+        for (int x = 0; x < shm->width; x++) {
+            fputc(row[x*4 + 2], file);
+            fputc(row[x*4 + 1], file);
+            fputc(row[x*4 + 0], file);
+        }
+    }
+
+    fclose(file);
+    free(path);
+}
+
+void workload_step(enum Workload workload, struct Bar *bar, int frame) {
+    char text[256];
+
+    switch (workload) {
+        case Workload_Status:
+            snprintf(text, sizeof(text), "cpu %2d%% | mem %4d MiB | bat %3d%% | %02d:%02d:%02d",
+                    frame * 7 % 100, 2048 + frame * 13 % 512, 100 - frame / 60 % 100,
+                    frame / 3600 % 24, frame / 60 % 60, frame % 60);
+            bar_set_status(bar, text);
+            break;
+        case Workload_Title:
+            snprintf(text, sizeof(text), "~/src/dwl-bar/src/render.c (%d) - nvim", (int)(frame % (layout_cache_size * 2)));
+            bar_set_title(bar, text);
+            break;
+        case Workload_Tags:
+            for (int i = 0; i < LENGTH(tags); i++)
+                bar_set_tag(bar, i, i == frame % LENGTH(tags) ? Tag_Active : Tag_None,
+                        (frame >> i) & 1, i == frame % LENGTH(tags));
+            bar_set_layout(bar, frame % 2 ? "[]=" : "><>");
+            bar_set_active(bar, frame % 3 != 0);
+            break;
+        case Workload_UTF8:
+            snprintf(text, sizeof(text), "%s %d", utf8_titles[frame % LENGTH(utf8_titles)], frame);
+            bar_set_title(bar, text);
+            break;
+        case Workload_All:
+            for (int i = 0; i < Workload_All; i++)
+                workload_step(i, bar, frame);
+            break;
+        case Workload_Last:
+            break;
+    }
+}
+
+void workload_run(enum Workload workload, int frames, int width, int height, int transient, const char *ppm_directory) {
+    struct List *hotspots = list_create(1);
+    struct Pipeline *pipeline = pipeline_create(NULL);
+    struct Bar *bar = bar_create(hotspots, pipeline);
+    pipeline_show_offscreen(pipeline, width, height ? height : (int)pipeline->font->height + 2);
+    pipeline->shm->transient = transient;
+
+    /* Warm up, the first frames shape tag labels and build tiles which is not what is being measured. */
+    for (int i = 0; i < 16; i++) {
+        workload_step(workload, bar, -i - 1 + frames * 2);
+        pipeline_render_offscreen(pipeline);
+    }
+
+    uint64_t *times = ecalloc(frames, sizeof(*times));
+    unsigned long allocated = 0;
+    struct timespec start, end, begin;
+    clock_gettime(CLOCK_MONOTONIC, &begin);
+
+    for (int i = 0; i < frames; i++) {
+        unsigned long before = allocations_count();
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        workload_step(workload, bar, i);
+        pipeline_render_offscreen(pipeline);
+
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        allocated += allocations_count() - before;
+        times[i] = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000 + (end.tv_nsec - start.tv_nsec);
+
+        if (ppm_directory)
+            ppm_write(ppm_directory, workload_names[workload], i, pipeline->shm);
+    }
+
+    double total = (end.tv_sec - begin.tv_sec) + (end.tv_nsec - begin.tv_nsec) / 1e9;
+    qsort(times, frames, sizeof(*times), frame_cmp);
+    printf("%-8s %6d frames %10.1f fps   p50 %8.1f us   p99 %8.1f us   %7.1f allocs/frame\n",
+            workload_names[workload], frames, frames / total,
+            times[frames / 2] / 1e3, times[(frames * 99) / 100] / 1e3, (double)allocated / frames);
+
+    free(times);
+    bar_destroy(bar);
+    pipeline_destroy(pipeline);
+    list_elements_destroy(hotspots, free);
+}
+
+int main(int argc, char *argv[]) {
+    int opt, frames = 2000, width = 1920, height = 0, selected = -1, transient = 0;
+    const char *ppm_directory = NULL;
+
+    while((opt = getopt(argc, argv, "n:w:H:W:p:ch")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = atoi(optarg);
+                break;
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'H':
+                height = atoi(optarg);
+                break;
+            case 'W':
+                for (int i = 0; i < Workload_Last; i++)
+                    if (STRING_EQUAL(optarg, workload_names[i]))
+                        selected = i;
+                if (selected == -1)
+                    panic("Unknown workload: %s", optarg);
+                break;
+            case 'p':
+                ppm_directory = optarg;
+                if (mkdir(ppm_directory, 0755) < 0 && errno != EEXIST)
+                    panic("mkdir %s", ppm_directory);
+                break;
+            case 'c':
+                transient = 1;
+                break;
+            case 'h':
+            default:
+                printf("Usage: %s [-n frames] [-w width] [-H height] [-W status|title|tags|utf8|all] [-p ppm directory] [-c]\n", argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    if (frames <= 0 || width <= 0 || height < 0)
+        panic("Frames and sizes must be positive");
+
+    for (int i = 0; i < Workload_Last; i++)
+        if (selected == -1 || selected == i)
+            workload_run(i, frames, width, height, transient, ppm_directory);
+
+    return EXIT_SUCCESS;
+}
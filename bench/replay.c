@@ -0,0 +1,455 @@
+/*
+ * Input replay benchmark. Feeds a recording made with `dwl-bar -r file` through the real pointer and touch
+ * listeners against headless monitors, reporting how long each event takes, how much it allocates and which
+ * clicks it produced, so recordings double as regression tests for gesture and scroll handling.
+ * Pointer events are handled without touching the heap, the replay fails if any of them allocates.
+ * With -c it also fails unless the clicks are exactly those the synthetic session from -g produces.
+ */
+#include "alloc.h"
+#include "input.h"
+#include "main.h"
+#include "record.h"
+#include "render.h"
+#include "shm.h"
+#include "user.h"
+#include "util.h"
+#include <getopt.h>
+#include <linux/input-event-codes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPLAY_MONITORS 8
+#define REPLAY_CLICKS 64
+#define REPLAY_TAGS 9
+
+/* Which button some location was clicked with, and how often. */
+struct ReplayClick {
+    int location;
+    uint32_t button;
+    unsigned long count;
+};
+
+static int clicks_check(void);
+static void click_count(struct Monitor *monitor, void *data, uint32_t button, const struct Region *region);
+static int event_cmp(const void *left, const void *right);
+static void generate(const char *path, int width);
+static void generate_write(FILE *file, enum RecordEvent event, uint32_t time, int32_t arg0, int32_t arg1, int32_t arg2);
+static struct Monitor *replay_monitor(uint32_t wl_name, int width, int height);
+static void replay_dispatch(const struct Record *record, int width, int height);
+static struct Record *replay_read(const char *path, size_t *length);
+
+/* Unused here, but render.c, shm.c and input.c expect them to exist. */
+struct wl_compositor *compositor;
+struct zwlr_layer_shell_v1 *shell;
+struct wl_shm *shm;
+
+static const char *location_names[] = {
+    [Click_None] = "none",
+    [Click_Tag] = "tag",
+    [Click_Layout] = "layout",
+    [Click_Title] = "title",
+    [Click_Status] = "status",
+};
+
+static const struct HotspotListener click_listener = {
+    .click = click_count,
+};
+
+/* What one pass over the synthetic session clicks, see generate. */
+static const struct ReplayClick synthetic_clicks[] = {
+    /* 200 clicks, every third with the right button, and 100 taps, two in three held into a right click */
+    { Click_Tag, BTN_LEFT, 167 },
+    { Click_Tag, BTN_RIGHT, 133 },
+    /* Touchpad scrolling, and the swipes to the left which end over the title */
+    { Click_Title, Scroll_Down, 51 },
+    { Click_Title, Scroll_Up, 100 },
+    /* 50 notches each way from the hi-res wheel, whose continuous values must not scroll on top, and a classic wheel sideways */
+    { Click_Layout, Scroll_Down, 50 },
+    { Click_Layout, Scroll_Up, 50 },
+    { Click_Layout, Scroll_Left, 50 },
+    { Click_Layout, Scroll_Right, 50 },
+};
+
+static struct Hotspot hotspot = { .listener = &click_listener };
+static struct Pointer pointer;
+static struct Touch touch;
+static struct Monitor *monitors[REPLAY_MONITORS];
+static int monitors_length = 0;
+static struct ReplayClick clicks[REPLAY_CLICKS];
+static int clicks_length = 0;
+static unsigned long events_skipped = 0;
+static uint64_t generate_timestamp = 0;
+
+void click_count(struct Monitor *monitor, void *data, uint32_t button, const struct Region *region) {
+    for (int i = 0; i < clicks_length; i++) {
+        if (clicks[i].location == region->location && clicks[i].button == button) {
+            clicks[i].count++;
+            return;
+        }
+    }
+
+    if (clicks_length == REPLAY_CLICKS)
+        return;
+
+    clicks[clicks_length++] = (struct ReplayClick){ .location = region->location, .button = button, .count = 1 };
+}
+
+/* Returns the number of clicks that differ from synthetic_clicks. */
+int clicks_check(void) {
+    int mismatches = 0;
+    unsigned long count;
+
+    for (int i = 0; i < LENGTH(synthetic_clicks); i++) {
+        count = 0;
+        for (int j = 0; j < clicks_length; j++)
+            if (clicks[j].location == synthetic_clicks[i].location && clicks[j].button == synthetic_clicks[i].button)
+                count = clicks[j].count;
+
+        if (count == synthetic_clicks[i].count)
+            continue;
+        fprintf(stderr, "[bench-replay] click %s button %u: %lu, expected %lu\n", location_names[synthetic_clicks[i].location],
+                synthetic_clicks[i].button, count, synthetic_clicks[i].count);
+        mismatches++;
+    }
+
+    if (clicks_length != LENGTH(synthetic_clicks)) {
+        fprintf(stderr, "[bench-replay] %d kinds of clicks, expected %d\n", clicks_length, (int)LENGTH(synthetic_clicks));
+        mismatches++;
+    }
+    return mismatches;
+}
+
+int event_cmp(const void *left, const void *right) {
+    uint64_t l = *(const uint64_t*)left, r = *(const uint64_t*)right;
+    return (l > r) - (l < r);
+}
+
+/* A synthetic session on one monitor: tag clicks, a smooth scroll storm, a hi-res wheel and touch swipes and taps. */
+void generate(const char *path, int width) {
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        panic("fopen %s", path);
+    fwrite(RECORD_MAGIC, 1, strlen(RECORD_MAGIC), file);
+
+    uint32_t time = 1000;
+    int tag_width = width / 32;
+
+    generate_write(file, Record_Pointer_Enter, 1, wl_fixed_from_int(2), wl_fixed_from_int(2), 0);
+    generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+
+    for (int i = 0; i < 200; i++) {
+        int x = (i % REPLAY_TAGS) * tag_width + tag_width / 2;
+        generate_write(file, Record_Pointer_Motion, time++, wl_fixed_from_int(x), wl_fixed_from_int(5), 0);
+        generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+        generate_write(file, Record_Pointer_Button, time++, i % 3 ? BTN_LEFT : BTN_RIGHT, WL_POINTER_BUTTON_STATE_PRESSED, 0);
+        generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+        generate_write(file, Record_Pointer_Button, time++, i % 3 ? BTN_LEFT : BTN_RIGHT, WL_POINTER_BUTTON_STATE_RELEASED, 0);
+        generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+    }
+
+    /* Touchpad scrolling over the title, many small continuous steps. */
+    generate_write(file, Record_Pointer_Motion, time++, wl_fixed_from_int(width / 2), wl_fixed_from_int(5), 0);
+    generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+    for (int i = 0; i < 2000; i++) {
+        generate_write(file, Record_Pointer_Axis_Source, 0, WL_POINTER_AXIS_SOURCE_FINGER, 0, 0);
+        generate_write(file, Record_Pointer_Axis, time++, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_double(i % 200 < 100 ? 2.5 : -2.5), 0);
+        generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+    }
+    generate_write(file, Record_Pointer_Axis_Stop, time++, WL_POINTER_AXIS_VERTICAL_SCROLL, 0, 0);
+    generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+
+    /* A hi-res wheel over the layout symbol, a quarter notch at a time, plus a classic wheel. */
+    generate_write(file, Record_Pointer_Motion, time++, wl_fixed_from_int(REPLAY_TAGS * tag_width + tag_width / 2), wl_fixed_from_int(5), 0);
+    generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+    for (int i = 0; i < 400; i++) {
+        generate_write(file, Record_Pointer_Axis_Source, 0, WL_POINTER_AXIS_SOURCE_WHEEL, 0, 0);
+        generate_write(file, Record_Pointer_Axis_Value120, 0, WL_POINTER_AXIS_VERTICAL_SCROLL, i % 80 < 40 ? 30 : -30, 0);
+        generate_write(file, Record_Pointer_Axis, time++, WL_POINTER_AXIS_VERTICAL_SCROLL, wl_fixed_from_double(i % 80 < 40 ? 3.75 : -3.75), 0);
+        generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+    }
+    for (int i = 0; i < 100; i++) {
+        generate_write(file, Record_Pointer_Axis_Source, 0, WL_POINTER_AXIS_SOURCE_WHEEL, 0, 0);
+        generate_write(file, Record_Pointer_Axis_Discrete, 0, WL_POINTER_AXIS_HORIZONTAL_SCROLL, i % 2 ? 1 : -1, 0);
+        generate_write(file, Record_Pointer_Axis, time++, WL_POINTER_AXIS_HORIZONTAL_SCROLL, wl_fixed_from_int(i % 2 ? 15 : -15), 0);
+        generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+    }
+    generate_write(file, Record_Pointer_Leave, 2, 0, 0, 0);
+    generate_write(file, Record_Pointer_Frame, 0, 0, 0, 0);
+
+    /* Swipes both ways across the status, then taps and holds on the tags. */
+    for (int i = 0; i < 100; i++) {
+        int start = width - width / 4, direction = i % 2 ? 1 : -1;
+        generate_write(file, Record_Touch_Down, time, 0, wl_fixed_from_int(start), wl_fixed_from_int(5));
+        generate_write(file, Record_Touch_Frame, 0, 0, 0, 0);
+        for (int step = 1; step <= 20; step++) {
+            generate_write(file, Record_Touch_Motion, time += 8, 0, wl_fixed_from_int(start + direction * step * width / 80), wl_fixed_from_int(5));
+            generate_write(file, Record_Touch_Frame, 0, 0, 0, 0);
+        }
+        generate_write(file, Record_Touch_Up, time++, 0, 0, 0);
+        generate_write(file, Record_Touch_Frame, 0, 0, 0, 0);
+    }
+    for (int i = 0; i < 100; i++) {
+        generate_write(file, Record_Touch_Down, time, i % 2, wl_fixed_from_int((i % REPLAY_TAGS) * tag_width + 1), wl_fixed_from_int(5));
+        generate_write(file, Record_Touch_Frame, 0, 0, 0, 0);
+        generate_write(file, Record_Touch_Up, time += (i % 3) * 400 + 100, i % 2, 0, 0);
+        generate_write(file, Record_Touch_Frame, 0, 0, 0, 0);
+    }
+
+    if (fclose(file) != 0)
+        panic("fclose %s", path);
+}
+
+void generate_write(FILE *file, enum RecordEvent event, uint32_t time, int32_t arg0, int32_t arg1, int32_t arg2) {
+    struct Record record = {
+        .timestamp = generate_timestamp,
+        .event = event,
+        /* Only events carrying a surface name a monitor. */
+        .monitor = event == Record_Pointer_Enter || event == Record_Pointer_Leave || event == Record_Touch_Down
+            ? 1 : RECORD_NO_MONITOR,
+        .time = time,
+        .args = { arg0, arg1, arg2 },
+    };
+
+    /* Roughly a 1kHz device. */
+    generate_timestamp += 1000000;
+    if (fwrite(&record, sizeof(record), 1, file) != 1)
+        panic("fwrite");
+}
+
+struct Monitor *monitor_from_surface(const struct wl_surface *surface) {
+    for (int i = 0; i < monitors_length; i++)
+        if ((const struct wl_surface*)monitors[i] == surface)
+            return monitors[i];
+
+    return NULL;
+}
+
+void panic(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    fprintf(stderr, "[bench-replay] panic: ");
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    exit(EXIT_FAILURE);
+}
+
+void replay_dispatch(const struct Record *record, int width, int height) {
+    /* The monitor itself stands in for its surface, see monitor_from_surface. */
+    struct wl_surface *surface = record->monitor == RECORD_NO_MONITOR ? NULL
+        : (struct wl_surface*)replay_monitor(record->monitor, width, height);
+    const int32_t *args = record->args;
+
+    switch (record->event) {
+        case Record_Pointer_Enter:
+            pointer_listener.enter(&pointer, NULL, record->time, surface, args[0], args[1]);
+            break;
+        case Record_Pointer_Leave:
+            pointer_listener.leave(&pointer, NULL, record->time, surface);
+            break;
+        case Record_Pointer_Motion:
+            pointer_listener.motion(&pointer, NULL, record->time, args[0], args[1]);
+            break;
+        case Record_Pointer_Button:
+            pointer_listener.button(&pointer, NULL, 0, record->time, args[0], args[1]);
+            break;
+        case Record_Pointer_Axis:
+            pointer_listener.axis(&pointer, NULL, record->time, args[0], args[1]);
+            break;
+        case Record_Pointer_Frame:
+            pointer_listener.frame(&pointer, NULL);
+            break;
+        case Record_Pointer_Axis_Source:
+            pointer_listener.axis_source(&pointer, NULL, args[0]);
+            break;
+        case Record_Pointer_Axis_Stop:
+            pointer_listener.axis_stop(&pointer, NULL, record->time, args[0]);
+            break;
+        case Record_Pointer_Axis_Discrete:
+            pointer_listener.axis_discrete(&pointer, NULL, args[0], args[1]);
+            break;
+        case Record_Pointer_Axis_Value120:
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+            pointer_listener.axis_value120(&pointer, NULL, args[0], args[1]);
+#else
+            events_skipped++;
+#endif
+            break;
+        case Record_Touch_Down:
+            touch_listener.down(&touch, NULL, 0, record->time, surface, args[0], args[1], args[2]);
+            break;
+        case Record_Touch_Up:
+            touch_listener.up(&touch, NULL, 0, record->time, args[0]);
+            break;
+        case Record_Touch_Motion:
+            touch_listener.motion(&touch, NULL, record->time, args[0], args[1], args[2]);
+            break;
+        case Record_Touch_Frame:
+            touch_listener.frame(&touch, NULL);
+            break;
+        case Record_Touch_Cancel:
+            touch_listener.cancel(&touch, NULL);
+            break;
+        case Record_Touch_Shape:
+            touch_listener.shape(&touch, NULL, args[0], args[1], args[2]);
+            break;
+        case Record_Touch_Orientation:
+            touch_listener.orientation(&touch, NULL, args[0], args[1]);
+            break;
+        default:
+            events_skipped++;
+    }
+}
+
+/* A headless stand-in for the output with this wl_name, laid out like the default bar: tags, layout, title, status. */
+struct Monitor *replay_monitor(uint32_t wl_name, int width, int height) {
+    for (int i = 0; i < monitors_length; i++)
+        if (monitors[i]->wl_name == wl_name)
+            return monitors[i];
+
+    if (monitors_length == REPLAY_MONITORS)
+        panic("Recording has more than %d monitors", REPLAY_MONITORS);
+
+    struct Monitor *monitor = ecalloc(1, sizeof(*monitor));
+    monitor->wl_name = wl_name;
+    monitor->pipeline = ecalloc(1, sizeof(*monitor->pipeline));
+    monitor->pipeline->shm = shm_create_offscreen(width, height);
+
+    struct Pipeline *pipeline = monitor->pipeline;
+    int tag_width = width / 32, x = 0;
+    for (int i = 0; i < REPLAY_TAGS; i++, x += tag_width)
+        pipeline_region_add(pipeline, &hotspot, x, x + tag_width, Click_Tag, i);
+    pipeline_region_add(pipeline, &hotspot, x, x + tag_width, Click_Layout, 0);
+    x += tag_width;
+    pipeline_region_add(pipeline, &hotspot, x, width / 2 + width / 8, Click_Title, 0);
+    pipeline_region_add(pipeline, &hotspot, width / 2 + width / 8, width, Click_Status, 0);
+
+    monitors[monitors_length++] = monitor;
+    return monitor;
+}
+
+struct Record *replay_read(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        panic("fopen %s", path);
+
+    char magic[sizeof(RECORD_MAGIC)-1];
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) || memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0)
+        panic("%s is not a dwl-bar recording", path);
+
+    size_t capacity = 1024;
+    struct Record *records = ecalloc(capacity, sizeof(*records));
+    *length = 0;
+    while (fread(&records[*length], sizeof(*records), 1, file) == 1) {
+        if (++*length < capacity)
+            continue;
+        capacity *= 2;
+        if (!(records = realloc(records, capacity * sizeof(*records))))
+            panic("realloc");
+    }
+
+    fclose(file);
+    return records;
+}
+
+int main(int argc, char *argv[]) {
+    int opt, repeats = 10, width = 1920, height = 24, check = 0, mismatches = 0;
+    const char *generate_path = NULL;
+
+    while((opt = getopt(argc, argv, "n:w:g:ch")) != -1) {
+        switch (opt) {
+            case 'n':
+                repeats = atoi(optarg);
+                break;
+            case 'w':
+                width = atoi(optarg);
+                break;
+            case 'g':
+                generate_path = optarg;
+                break;
+            case 'c':
+                check = 1;
+                break;
+            case 'h':
+            default:
+                printf("Usage: %s [-n repeats] [-w width] [-g file] [-c] [recording]\n", argv[0]);
+                exit(opt == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
+        }
+    }
+
+    if (repeats <= 0 || width < 64)
+        panic("Repeats must be positive and width at least 64");
+
+    if (generate_path) {
+        generate(generate_path, width);
+        if (optind >= argc)
+            return EXIT_SUCCESS;
+    }
+
+    if (optind >= argc)
+        panic("No recording given");
+
+    size_t length;
+    struct Record *records = replay_read(argv[optind], &length);
+    if (length == 0)
+        panic("%s has no events", argv[optind]);
+
+    for (int i = 0; i < LENGTH(touch.points); i++)
+        touch.points[i].id = -1;
+
+    size_t total = length * repeats;
+    uint64_t *times = ecalloc(total, sizeof(*times)), elapsed = 0;
+    struct timespec start, end;
+
+    /* Every monitor is set up before anything is measured, so only the input handlers are counted. */
+    for (size_t i = 0; i < length; i++)
+        if (records[i].monitor != RECORD_NO_MONITOR)
+            replay_monitor(records[i].monitor, width, height);
+
+    unsigned long allocations = allocations_count(), pointer_allocations = 0, before;
+    for (int repeat = 0; repeat < repeats; repeat++) {
+        for (size_t i = 0; i < length; i++) {
+            before = allocations_count();
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            replay_dispatch(&records[i], width, height);
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            if (records[i].event <= Record_Pointer_Axis_Value120)
+                pointer_allocations += allocations_count() - before;
+
+            uint64_t ns = (end.tv_sec - start.tv_sec) * 1000000000ull + end.tv_nsec - start.tv_nsec;
+            times[repeat * length + i] = ns;
+            elapsed += ns;
+        }
+        /* Only the first pass counts clicks, every pass is identical. */
+        if (repeat != 0)
+            continue;
+        for (int j = 0; j < clicks_length; j++)
+            printf("click %s button %u: %lu\n", location_names[clicks[j].location], clicks[j].button, clicks[j].count);
+        if (check)
+            mismatches = clicks_check();
+    }
+    allocations = allocations_count() - allocations;
+
+    qsort(times, total, sizeof(*times), event_cmp);
+    printf("%zu events over %.2fs recorded, %zu replayed %d times, %lu skipped\n",
+            length, records[length-1].timestamp / 1e9, length, repeats, events_skipped);
+    printf("%.0f events/s, p50 %luns, p99 %luns, %.3f allocations/event\n",
+            total / (elapsed / 1e9), (unsigned long)times[total / 2], (unsigned long)times[total * 99 / 100],
+            (double)allocations / total);
+
+    for (int i = 0; i < monitors_length; i++) {
+        shm_destroy(monitors[i]->pipeline->shm);
+        free(monitors[i]->pipeline->regions);
+        free(monitors[i]->pipeline);
+        free(monitors[i]);
+    }
+    free(times);
+    free(records);
+
+    if (pointer_allocations)
+        fprintf(stderr, "[bench-replay] pointer events allocated %lu times\n", pointer_allocations);
+    return pointer_allocations || mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -10,36 +10,97 @@
 #include "util.h"
 #include "log.h"
 #include "pango/pango.h"
+#include "pango/pangocairo.h"
+#include <string.h>
 #include <unistd.h>
 
-static void bar_click(struct Monitor *monitor, void *data, uint32_t button, double x, double y);
-static int bar_component_add_elipses(struct BasicComponent *component, struct Pipeline *pipeline, int limit);
+static void bar_blocks_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int *x, int *y);
+static void bar_blocks_width(struct Pipeline *pipeline, struct Bar *bar);
+static void bar_click(struct Monitor *monitor, void *data, uint32_t button, const struct Region *region);
+static void bar_component_clear(struct BasicComponent *component, struct Pipeline *pipeline, cairo_t *painter, int x);
 static struct BasicComponent *bar_component_create(struct Pipeline *pipeline);
 static int bar_component_width(struct BasicComponent *component, struct Pipeline *pipeline);
-static void bar_bounds(void *data, double *x, double *y, double *width, double *height);
-static enum Clicked bar_get_location(struct Bar *bar, double x, double y, int *tag_index);
+static void bar_fit(struct Pipeline *pipeline, struct Bar *bar, int title_width, unsigned int future_widths);
+static const struct GlyphAtlas *bar_grid_atlas(struct Pipeline *pipeline, struct Bar *bar, int height);
+static void bar_grid_deactivate(struct Bar *bar);
+static void bar_grid_destroy(struct Bar *bar);
+static void bar_grid_measure(struct Pipeline *pipeline, struct Bar *bar);
+static int bar_grid_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int x, int y);
+static int bar_grid_set(struct Bar *bar, const char *text);
 static void bar_layout_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int *x, int *y);
 static void bar_render(struct Pipeline *pipeline, void *data, cairo_t *painter, int *x, int *y);
+static cairo_surface_t *bar_tag_tile_create(struct Pipeline *pipeline, struct Tag *tag,
+        enum ColorScheme scheme, enum TagIndicator indicator);
 static void bar_tags_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int *x, int *y);
 static void bar_title_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int *x, int *y);
 static void bar_status_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int *x, int *y);
+static void bar_status_scheme(struct Pipeline *pipeline, struct Bar *bar);
+static int bar_status_width(struct Pipeline *pipeline, struct Bar *bar);
+static void bar_tag_look(const struct Tag *tag, enum ColorScheme *scheme, enum TagIndicator *indicator);
+static void bar_tiles_destroy(struct Bar *bar);
+static void bar_tiles_prepare(struct Pipeline *pipeline, struct Bar *bar);
 static int bar_width(struct Pipeline *pipeline, void *data, unsigned int future_widths);
 
 const struct PipelineListener bar_pipeline_listener = { .render = bar_render, .width = bar_width, };
-const struct HotspotListener bar_hotspot_listener = { .click = bar_click, .bounds = bar_bounds };
+const struct HotspotListener bar_hotspot_listener = { .click = bar_click };
+
+/* Draws the blocks right after the status, in the status' colors. */
+void bar_blocks_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int *x, int *y) {
+    struct BasicComponent *component;
+    int start = *x;
+
+    for (int i = 0; i < bar->blocks_length * 2; i++) {
+        component = i % 2 ? bar->blocks[i / 2] : bar->separators[i / 2];
+        component->height = pipeline->shm->height;
+        if (*x + component->width > pipeline->shm->width)
+            component->width = pipeline->shm->width > *x ? pipeline->shm->width - *x : 0;
+        if (!component->width) {
+            bar_component_clear(component, pipeline, painter, *x);
+            continue;
+        }
+
+        basic_component_render(component, pipeline, painter, x, y);
+        *x += component->width;
+    }
+
+    pipeline_region_add(pipeline, bar->hotspot, start, *x, Click_Status, 0);
+}
+
+/*
+ * Empty blocks take no room, a separator only comes before a block if something is shown ahead of it.
+ * The last block shown is padded like the other components.
+ */
+void bar_blocks_width(struct Pipeline *pipeline, struct Bar *bar) {
+    struct BasicComponent *last = NULL;
+    int shown = bar->grid.active ? bar->grid.length > 0 : basic_component_text_width(bar->status) > 0;
+
+    bar->blocks_width = 0;
+    for (int i = 0; i < bar->blocks_length; i++) {
+        bar->blocks[i]->width = basic_component_text_width(bar->blocks[i]);
+        bar->separators[i]->width = bar->blocks[i]->width && shown ? basic_component_text_width(bar->separators[i]) : 0;
+        bar->blocks_width += bar->separators[i]->width + bar->blocks[i]->width;
+        if (bar->blocks[i]->width) {
+            shown = 1;
+            last = bar->blocks[i];
+        }
+    }
+
+    if (last) {
+        last->width += pipeline->font->height / 2;
+        bar->blocks_width += pipeline->font->height / 2;
+    }
+}
 
-void bar_click(struct Monitor *monitor, void *data, uint32_t button, double x, double y) {
-    if (!monitor || !data)
+void bar_click(struct Monitor *monitor, void *data, uint32_t button, const struct Region *region) {
+    if (!monitor || !data || !region)
         return;
 
-    struct Bar *bar = data;
     const struct Binding *binding;
     union Arg *argp = NULL, arg;
-    int tag_index = -1;
-    enum Clicked clicked = bar_get_location(bar, x, y, &tag_index);
+    enum Clicked clicked = region->location;
 
     if (clicked == Click_Tag) {
-        arg.ui = tag_index;
+        arg.ui = region->index;
         argp = &arg;
     }
 
@@ -52,27 +113,26 @@ void bar_click(struct Monitor *monitor, void *data, uint32_t button, double x, d
     }
 }
 
-int bar_component_add_elipses(struct BasicComponent *component, struct Pipeline *pipeline, int limit) {
-    const char *current_string = pango_layout_get_text(component->layout);
-    char *new_string;
-    const int elipses_amnt = 3;
-    int i;
-
-    for (i = strlen(current_string);
-            (((i+elipses_amnt)*pipeline->font->approx_width)+pipeline->font->height > limit && i >= 0);
-            i--);
-
-    if (i <= 0)
-        return 0;
+/*
+ * Paints over what a component left behind when it stops taking any room. Only the part from x on is painted,
+ * whatever is left of x was already drawn this frame.
+ */
+void bar_component_clear(struct BasicComponent *component, struct Pipeline *pipeline, cairo_t *painter, int x) {
+    struct Rect *drawn = &component->drawn;
+    if (drawn->width <= 0 || drawn->height <= 0)
+        return;
 
-    new_string = strncpy(ecalloc(i+elipses_amnt+1, sizeof(*new_string)),
-            current_string, i);
-    new_string[i+1] = '\0';
-    new_string = strcat(new_string, "...");
+    pipeline_damage(pipeline, drawn);
+    int start = drawn->x > x ? drawn->x : x, end = drawn->x + drawn->width;
+    if (end > start) {
+        cairo_save(painter);
+        cairo_rectangle(painter, start, drawn->y, end - start, drawn->height);
+        pipeline_color_background(pipeline, painter);
+        cairo_fill(painter);
+        cairo_restore(painter);
+    }
 
-    pango_layout_set_text(component->layout, new_string, -1);
-    free(new_string);
-    return bar_component_width(component, pipeline);
+    *drawn = (struct Rect){ 0 };
 }
 
 struct BasicComponent *bar_component_create(struct Pipeline *pipeline) {
@@ -89,45 +149,215 @@ int bar_component_width(struct BasicComponent *component, struct Pipeline *pipel
     return basic_component_text_width(component) + pipeline->font->height;
 }
 
-void bar_bounds(void *data, double *x, double *y, double *width, double *height) {
-    struct Bar *bar = data;
-    int bar_width = 0;
-    struct Tag *tag;
-    for (int i = 0; i < LENGTH(bar->tags); i++) {
-        tag = &bar->tags[i];
-        bar_width += tag->component->width;
+/* Sizes the title and status for this frame, ellipsizing either if it doesn't fit. */
+void bar_fit(struct Pipeline *pipeline, struct Bar *bar, int title_width, unsigned int future_widths) {
+    int available = pipeline->shm->width - bar->tags_width - bar->layout->width - title_width
+        - bar->blocks_width - future_widths;
+
+    bar->title->width = title_width;
+    if (bar->status->width > available)
+        bar->status->width = available > 0 ? available : 0;
+
+    basic_component_fit(bar->title, bar->title->width - pipeline->font->height);
+    /* The grid is only kept while the status fits, see bar_width. */
+    if (!bar->grid.active)
+        basic_component_fit(bar->status, bar->status->width - pipeline->font->height);
+}
+
+/* Finds or renders the atlas for the current colors, replacing the oldest one. */
+const struct GlyphAtlas *bar_grid_atlas(struct Pipeline *pipeline, struct Bar *bar, int height) {
+    struct StatusGrid *grid = &bar->grid;
+    struct GlyphAtlas *atlas;
+
+    for (int i = 0; i < LENGTH(grid->atlases); i++) {
+        atlas = &grid->atlases[i];
+        if (atlas->glyphs && atlas->height == height
+                && memcmp(atlas->foreground, pipeline->foreground, sizeof(atlas->foreground)) == 0
+                && memcmp(atlas->background, pipeline->background, sizeof(atlas->background)) == 0)
+            return atlas;
     }
-    bar_width += bar->layout->width;
-    bar_width += bar->title->width;
-    bar_width += bar->status->width;
 
-    *x = bar->x;
-    *y = bar->y;
-    *width = bar_width;
-    *height = bar->pipeline->shm->height;
+    atlas = &grid->atlases[grid->next_atlas];
+    grid->next_atlas = (grid->next_atlas + 1) % LENGTH(grid->atlases);
+    if (atlas->glyphs)
+        cairo_surface_destroy(atlas->glyphs);
+    if (grid->drawn_atlas == atlas)
+        grid->drawn_atlas = NULL;
+
+    atlas->glyphs = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, grid->cell_width * ATLAS_GLYPHS, height);
+    atlas->height = height;
+    memcpy(atlas->foreground, pipeline->foreground, sizeof(atlas->foreground));
+    memcpy(atlas->background, pipeline->background, sizeof(atlas->background));
+
+    cairo_t *painter = cairo_create(atlas->glyphs);
+    pipeline_color_background(pipeline, painter);
+    cairo_paint(painter);
+    pipeline_color_foreground(pipeline, painter);
+    cairo_move_to(painter, 0, bar->status->ty);
+    pipeline_show_layout(painter, grid->charset);
+    cairo_destroy(painter);
+    cairo_surface_flush(atlas->glyphs);
+
+    return atlas;
 }
 
-enum Clicked bar_get_location(struct Bar *bar, double x, double y, int *tag_index) {
-    enum Clicked clicked = Click_None;
-    struct Tag *tag;
+/*
+ * Hand the status back to its layout, which is older than what was last shown.
+ * The caller sets the status' text right after.
+ */
+void bar_grid_deactivate(struct Bar *bar) {
+    bar->grid.active = 0;
+    bar->status->dirty = 1;
+}
 
-    for (int i = 0; i < LENGTH(bar->tags); i++) {
-        tag = &bar->tags[i];
-        if (basic_component_is_clicked(tag->component, x, y)) {
-            clicked = Click_Tag;
-            *tag_index = i;
-            return clicked;
-        }
+void bar_grid_destroy(struct Bar *bar) {
+    struct StatusGrid *grid = &bar->grid;
+
+    if (grid->charset)
+        g_object_unref(grid->charset);
+    if (grid->description)
+        pango_font_description_free(grid->description);
+    for (int i = 0; i < LENGTH(grid->atlases); i++)
+        if (grid->atlases[i].glyphs)
+            cairo_surface_destroy(grid->atlases[i].glyphs);
+    free(grid->text);
+    free(grid->drawn);
+}
+
+/*
+ * Checks once whether the font can be drawn as a grid, which it can if every glyph in the atlas
+ * has the same advance and that advance is a whole number of pixels.
+ * The charset is shaped without ligatures. Fonts like Fira Code keep their advances but swap in joined
+ * glyphs for runs like "<=" or "--", which would leave fragments of them in the cells.
+ */
+void bar_grid_measure(struct Pipeline *pipeline, struct Bar *bar) {
+    struct StatusGrid *grid = &bar->grid;
+    char charset[ATLAS_GLYPHS + 1];
+    int narrow, wide, width;
+
+    grid->measured = 1;
+    grid->cell_width = 0;
+    for (int i = 0; i < ATLAS_GLYPHS; i++)
+        charset[i] = ATLAS_FIRST + i;
+    charset[ATLAS_GLYPHS] = '\0';
+
+    if (status_atlas_font)
+        grid->description = pango_font_description_from_string(status_atlas_font);
+    grid->charset = pango_layout_new(pipeline->context);
+    pango_layout_set_font_description(grid->charset, grid->description ? grid->description : pipeline->font->description);
+
+    PangoAttrList *attributes = pango_attr_list_new();
+    pango_attr_list_insert(attributes, pango_attr_font_features_new("liga=0, clig=0, dlig=0, calt=0"));
+    pango_layout_set_attributes(grid->charset, attributes);
+    pango_attr_list_unref(attributes);
+    pango_layout_set_text(grid->charset, "iiiiiiiiii", -1);
+    pango_layout_get_size(grid->charset, &narrow, NULL);
+    pango_layout_set_text(grid->charset, "WWWWWWWWWW", -1);
+    pango_layout_get_size(grid->charset, &wide, NULL);
+    pango_layout_set_text(grid->charset, charset, -1);
+    pango_layout_get_size(grid->charset, &width, NULL);
+
+    if (narrow != wide || narrow % (10 * PANGO_SCALE) || width != narrow / 10 * ATLAS_GLYPHS) {
+        bar_log(LOG_INFO, "%s isn't monospace, the status is drawn with Pango",
+                status_atlas_font ? status_atlas_font : pipeline->font->name);
+        return;
+    }
+
+    grid->cell_width = narrow / 10 / PANGO_SCALE;
+}
+
+/*
+ * Draws the status by copying glyph cells out of the atlas. Unless the status moved or changed length
+ * or colors, only the cells whose character changed are copied and damaged.
+ * Returns 0 if the status has to be drawn from its layout instead.
+ */
+int bar_grid_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int x, int y) {
+    struct StatusGrid *grid = &bar->grid;
+    struct BasicComponent *status = bar->status;
+    if (!grid->active)
+        return 0;
+
+    const struct GlyphAtlas *atlas = bar_grid_atlas(pipeline, bar, status->height);
+    struct Rect rect = { x, y, status->width, status->height },
+                cell = { 0, 0, grid->cell_width, status->height };
+    int text_x = x + status->tx,
+        full = pipeline->redraw || status->dirty || atlas != grid->drawn_atlas
+            || grid->length != grid->drawn_length
+            || rect.x != status->drawn.x || rect.y != status->drawn.y
+            || rect.width != status->drawn.width || rect.height != status->drawn.height;
+
+    status->x = x;
+    status->y = y;
+    if (full) {
+        pipeline_damage(pipeline, &status->drawn);
+        pipeline_damage(pipeline, &rect);
+
+        cairo_save(painter);
+        cairo_rectangle(painter, x, y, rect.width, rect.height);
+        cairo_clip(painter);
+        pipeline_color_background(pipeline, painter);
+        cairo_paint(painter);
+        cairo_restore(painter);
     }
 
-    if (basic_component_is_clicked(bar->layout, x, y))
-        clicked = Click_Layout;
-    else if (basic_component_is_clicked(bar->title, x, y))
-        clicked = Click_Title;
-    else if (basic_component_is_clicked(bar->status, x, y))
-        clicked = Click_Status;
+    for (size_t i = 0; i < grid->length; i++) {
+        if (!full && grid->text[i] == grid->drawn[i])
+            continue;
+
+        cell.x = (grid->text[i] - ATLAS_FIRST) * grid->cell_width;
+        pipeline_blit_rect(pipeline, painter, atlas->glyphs, &cell, text_x + i * grid->cell_width, y);
+        if (!full)
+            pipeline_damage(pipeline, &(struct Rect){ text_x + i * grid->cell_width, y, grid->cell_width, rect.height });
+    }
 
-    return clicked;
+    memcpy(grid->drawn, grid->text, grid->length);
+    grid->drawn_length = grid->length;
+    grid->drawn_atlas = atlas;
+    status->drawn = rect;
+    status->dirty = 0;
+    return 1;
+}
+
+/*
+ * Takes `text` into the grid if the atlas has every character of it.
+ * Returns 1 if the text changed, 0 if it didn't and -1 if it has to go through Pango.
+ */
+int bar_grid_set(struct Bar *bar, const char *text) {
+    struct StatusGrid *grid = &bar->grid;
+    size_t length;
+
+    if (!grid->cell_width)
+        return -1;
+
+    for (length = 0; text[length]; length++)
+        if ((unsigned char)text[length] < ATLAS_FIRST || (unsigned char)text[length] > ATLAS_LAST)
+            break;
+    if (text[length]) {
+        if (grid->active)
+            bar_grid_deactivate(bar);
+        return -1;
+    }
+
+    if (grid->active && length == grid->length && memcmp(text, grid->text, length) == 0)
+        return 0;
+    if (!grid->active && grid->unfit_width && length == grid->unfit_length)
+        return -1;
+
+    if (length + 1 > grid->capacity) {
+        grid->capacity = length + 1 > grid->capacity * 2 ? length + 1 : grid->capacity * 2;
+        grid->text = realloc(grid->text, grid->capacity);
+        grid->drawn = realloc(grid->drawn, grid->capacity);
+        if (!grid->text || !grid->drawn)
+            panic("Out of memory");
+    }
+
+    memcpy(grid->text, text, length + 1);
+    grid->length = length;
+    if (!grid->active) {
+        grid->active = 1;
+        bar->status->dirty = 1;
+    }
+    return 1;
 }
 
 struct Bar *bar_create(struct List *hotspots, struct Pipeline *pipeline) {
@@ -141,25 +371,37 @@ struct Bar *bar_create(struct List *hotspots, struct Pipeline *pipeline) {
     bar->status = bar_component_create(pipeline);
 
     char *status = string_create("dwl %.1f", VERSION);
-    pango_layout_set_text(bar->status->layout, status, strlen(status));
+    basic_component_set_text(bar->status, pipeline->layouts, status);
     free(status);
 
+    /* Blocks sit flush against each other and their separators, the separator has its own spaces. */
+    bar->blocks_length = status_modules ? LENGTH(status_blocks) : 0;
+    for (int i = 0; i < bar->blocks_length; i++) {
+        bar->blocks[i] = basic_component_create(pipeline->context, pipeline->font->description);
+        bar->blocks[i]->ty = 1;
+        bar->separators[i] = basic_component_create(pipeline->context, pipeline->font->description);
+        bar->separators[i]->ty = 1;
+        basic_component_set_text(bar->separators[i], pipeline->layouts, status_separator);
+    }
+    bar->blocks_width = 0;
+
     struct Tag *tag;
     for (int i = 0; i < LENGTH(tags); i++) {
         tag = &bar->tags[i];
         *tag = (struct Tag){ 0, 0, 0,
-            bar_component_create(pipeline) };
-        pango_layout_set_text(tag->component->layout, tags[i], strlen(tags[i]));
-        tag->component->width = basic_component_text_width(tag->component) + pipeline->font->height;
+            bar_component_create(pipeline), {{ NULL }} };
+        basic_component_set_text(tag->component, pipeline->layouts, tags[i]);
+        tag->component->width = bar_component_width(tag->component, pipeline);
+        bar->tags_width += tag->component->width;
     }
 
-    pipeline_add(pipeline, &bar_pipeline_listener, bar);
-    struct Hotspot *hotspot = list_add(hotspots, ecalloc(1, sizeof(*hotspot)));
-    hotspot->listener = &bar_hotspot_listener;
-    hotspot->data = bar;
+    bar->tiles_font = NULL;
+    bar->tiles_height = 0;
 
-    bar->x = 0;
-    bar->y = 0;
+    pipeline_add(pipeline, &bar_pipeline_listener, bar);
+    bar->hotspot = list_add(hotspots, ecalloc(1, sizeof(*bar->hotspot)));
+    bar->hotspot->listener = &bar_hotspot_listener;
+    bar->hotspot->data = bar;
 
     return bar;
 }
@@ -170,6 +412,12 @@ void bar_destroy(struct Bar *bar) {
     basic_component_destroy(bar->title);
     basic_component_destroy(bar->layout);
     basic_component_destroy(bar->status);
+    for (int i = 0; i < bar->blocks_length; i++) {
+        basic_component_destroy(bar->blocks[i]);
+        basic_component_destroy(bar->separators[i]);
+    }
+    bar_grid_destroy(bar);
+    bar_tiles_destroy(bar);
     struct Tag *tag;
     for (int i = 0; i < LENGTH(bar->tags); i++) {
         tag = &bar->tags[i];
@@ -182,11 +430,11 @@ void bar_layout_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *pain
     if (!bar || !pipeline)
         return;
 
-    bar->layout->width = bar_component_width(bar->layout, pipeline);
     bar->layout->height = pipeline->shm->height;
     pipeline_set_colorscheme(pipeline, schemes[InActive_Scheme]);
     basic_component_render(bar->layout, pipeline, painter, x, y);
 
+    pipeline_region_add(pipeline, bar->hotspot, *x, *x + bar->layout->width, Click_Layout, 0);
     *x += bar->layout->width;
 }
 
@@ -195,50 +443,122 @@ void bar_render(struct Pipeline *pipeline, void *data, cairo_t *painter, int *x,
         return;
 
     struct Bar *bar = data;
-    bar->x = *x;
-    bar->y = *y;
     bar_tags_render(pipeline, bar, painter, x, y);
     bar_layout_render(pipeline, bar, painter, x, y);
     bar_title_render(pipeline, bar, painter, x, y);
     bar_status_render(pipeline, bar, painter, x, y);
 }
 
+/* Render how a tag looks with the given scheme and indicator, so that afterwards it is only a copy. */
+cairo_surface_t *bar_tag_tile_create(struct Pipeline *pipeline, struct Tag *tag,
+        enum ColorScheme scheme, enum TagIndicator indicator) {
+    cairo_surface_t *tile = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            tag->component->width, tag->component->height);
+    cairo_t *painter = cairo_create(tile);
+
+    pipeline_set_colorscheme(pipeline, schemes[scheme]);
+    pipeline_color_background(pipeline, painter);
+    cairo_paint(painter);
+
+    pipeline_color_foreground(pipeline, painter);
+    cairo_move_to(painter, tag->component->tx, tag->component->ty);
+    pipeline_show_layout(painter, tag->component->layout);
+
+    /*  Creating the occupied tag box */
+    int boxHeight = pipeline->font->height / 9,
+        boxWidth  = pipeline->font->height / 6 + 1;
+
+    if (indicator == Indicator_Focused) {
+        cairo_rectangle(painter, boxHeight, boxHeight, boxWidth, boxWidth);
+        cairo_fill(painter);
+    } else if (indicator == Indicator_Occupied) {
+        cairo_rectangle(painter, boxHeight + 0.5, boxHeight + 0.5, boxWidth, boxWidth);
+        cairo_set_line_width(painter, 1);
+        cairo_stroke(painter);
+    }
+
+    cairo_destroy(painter);
+    cairo_surface_flush(tile);
+    return tile;
+}
+
 void bar_tags_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *painter, int *x, int *y) {
     if (!bar || !pipeline)
         return;
 
     struct Tag *tag;
+    enum ColorScheme scheme;
+    enum TagIndicator indicator;
     for (int i = 0; i < LENGTH(bar->tags); i++) {
         tag = &bar->tags[i];
+        if (!basic_component_damage(tag->component, pipeline, *x, *y))
+            goto done;
 
-        if (tag->state & Tag_Active)
-            pipeline_set_colorscheme(pipeline, schemes[Active_Scheme]);
-        else if (tag->state & Tag_Urgent)
-            pipeline_set_colorscheme(pipeline, schemes[Urgent_Scheme]);
-        else
-            pipeline_set_colorscheme(pipeline, schemes[InActive_Scheme]);
+        /* Built by bar_tiles_prepare */
+        bar_tag_look(tag, &scheme, &indicator);
+        pipeline_blit(pipeline, painter, tag->tiles[scheme][indicator], *x, *y);
 
-        tag->component->height = pipeline->shm->height;
-        basic_component_render(tag->component, pipeline, painter, x, y);
+done:
+        pipeline_region_add(pipeline, bar->hotspot, *x, *x + tag->component->width, Click_Tag, i);
+        *x += tag->component->width;
+    }
+}
 
-        if (!tag->occupied)
-            goto done;
+void bar_tag_look(const struct Tag *tag, enum ColorScheme *scheme, enum TagIndicator *indicator) {
+    if (tag->state & Tag_Active)
+        *scheme = Active_Scheme;
+    else if (tag->state & Tag_Urgent)
+        *scheme = Urgent_Scheme;
+    else
+        *scheme = InActive_Scheme;
+
+    if (!tag->occupied)
+        *indicator = Indicator_None;
+    else if (tag->has_focused)
+        *indicator = Indicator_Focused;
+    else
+        *indicator = Indicator_Occupied;
+}
 
-        /*  Creating the occupied tag box */
-        int boxHeight = pipeline->font->height / 9,
-            boxWidth  = pipeline->font->height / 6 + 1;
-
-        if (tag->has_focused) {
-            cairo_rectangle(painter, *x + boxHeight, boxHeight, boxWidth, boxWidth);
-            cairo_fill(painter);
-        } else {
-            cairo_rectangle(painter, *x + boxHeight + 0.5, boxHeight + 0.5, boxWidth, boxWidth);
-            cairo_set_line_width(painter, 1);
-            cairo_stroke(painter);
+void bar_tiles_destroy(struct Bar *bar) {
+    struct Tag *tag;
+    for (int i = 0; i < LENGTH(bar->tags); i++) {
+        tag = &bar->tags[i];
+        for (int j = 0; j < LENGTH(tag->tiles); j++) {
+            for (int k = 0; k < LENGTH(tag->tiles[j]); k++) {
+                if (!tag->tiles[j][k])
+                    continue;
+                cairo_surface_destroy(tag->tiles[j][k]);
+                tag->tiles[j][k] = NULL;
+            }
         }
+    }
+}
 
-done:
-        *x += tag->component->width;
+/*
+ * Renders the tag tiles and the glyph atlas this frame draws from. Rendering may run on a worker thread,
+ * so it only ever copies them.
+ */
+void bar_tiles_prepare(struct Pipeline *pipeline, struct Bar *bar) {
+    if (bar->tiles_font != pipeline->font || bar->tiles_height != pipeline->shm->height)
+        bar_tiles_destroy(bar);
+    bar->tiles_font = pipeline->font;
+    bar->tiles_height = pipeline->shm->height;
+
+    struct Tag *tag;
+    enum ColorScheme scheme;
+    enum TagIndicator indicator;
+    for (int i = 0; i < LENGTH(bar->tags); i++) {
+        tag = &bar->tags[i];
+        tag->component->height = pipeline->shm->height;
+        bar_tag_look(tag, &scheme, &indicator);
+        if (!tag->tiles[scheme][indicator])
+            tag->tiles[scheme][indicator] = bar_tag_tile_create(pipeline, tag, scheme, indicator);
+    }
+
+    if (bar->grid.active) {
+        bar_status_scheme(pipeline, bar);
+        bar_grid_atlas(pipeline, bar, pipeline->shm->height);
     }
 }
 
@@ -251,15 +571,10 @@ void bar_title_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *paint
     else
         pipeline_set_colorscheme(pipeline, schemes[InActive_Scheme]);
 
-    bar->title->width = pipeline->shm->width - *x - bar_component_width(bar->status, pipeline) - pipeline_get_future_widths(pipeline);
+    /* Sized and fitted by bar_fit */
     bar->title->height = pipeline->shm->height;
 
-    if (bar_component_width(bar->title, pipeline) > bar->title->width)
-        bar->title->width = bar_component_width(bar->title, pipeline);
-
-    basic_component_render(bar->title, pipeline, painter, x, y);
-
-    if (!bar->floating)
+    if (!basic_component_render(bar->title, pipeline, painter, x, y) || !bar->floating)
         goto done;
 
     int boxHeight = pipeline->font->height / 9,
@@ -271,6 +586,7 @@ void bar_title_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *paint
     cairo_stroke(painter);
 
 done:
+    pipeline_region_add(pipeline, bar->hotspot, *x, *x + bar->title->width, Click_Title, 0);
     *x += bar->title->width;
 }
 
@@ -278,101 +594,148 @@ void bar_status_render(struct Pipeline *pipeline, struct Bar *bar, cairo_t *pain
     if (!bar || !pipeline)
         return;
 
-    char *previous_status = NULL;
+    bar_status_scheme(pipeline, bar);
+    bar->status->height = pipeline->shm->height;
+    if (bar->status->width == 0) {
+        bar_component_clear(bar->status, pipeline, painter, *x);
+    } else {
+        if (!bar_grid_render(pipeline, bar, painter, *x, *y))
+            basic_component_render(bar->status, pipeline, painter, x, y);
+        pipeline_region_add(pipeline, bar->hotspot, *x, *x + bar->status->width, Click_Status, 0);
+        *x += bar->status->width;
+    }
+
+    bar_blocks_render(pipeline, bar, painter, x, y);
+}
 
+void bar_status_scheme(struct Pipeline *pipeline, struct Bar *bar) {
     pipeline_set_colorscheme(pipeline, schemes[InActive_Scheme]);
     if (!bar->active && status_on_active)
         pipeline_set_colorscheme(pipeline, (const int *[4]){ grey1, grey1 });
+}
 
-    bar->status->width = bar_component_width(bar->status, pipeline);
-    bar->status->height = pipeline->shm->height;
+/* The status' text and padding, the grid's cells while it is drawing the status. */
+int bar_status_width(struct Pipeline *pipeline, struct Bar *bar) {
+    if (bar->grid.active)
+        return bar->grid.length * bar->grid.cell_width + pipeline->font->height;
 
-    if (bar->status->width > (pipeline->shm->width - *x - pipeline_get_future_widths(pipeline))) {
-        previous_status = strdup(pango_layout_get_text(bar->status->layout));
-        bar->status->width = bar_component_add_elipses(bar->status, pipeline,
-                (pipeline->shm->width - *x - pipeline_get_future_widths(pipeline)));
-        if (bar->status->width == 0) {
-            free(previous_status);
-            return;
-        }
-    }
-
-    basic_component_render(bar->status, pipeline, painter, x, y);
+    return bar_component_width(bar->status, pipeline);
+}
 
-    if (previous_status) {
-        pango_layout_set_text(bar->status->layout, previous_status, -1);
-        free(previous_status);
-    }
+/* The setters return non-zero if anything visible changed, so callers know whether to redraw. */
+int bar_set_active(struct Bar *bar, unsigned int is_active) {
+    if (!bar || bar->active == is_active) return 0;
 
-    *x += bar->status->width;
+    bar->active = is_active;
+    /* Both are colored by whether the monitor is active. */
+    bar->title->dirty = 1;
+    bar->status->dirty = 1;
+    for (int i = 0; i < bar->blocks_length; i++)
+        bar->blocks[i]->dirty = bar->separators[i]->dirty = 1;
+    return 1;
 }
 
-void bar_set_active(struct Bar *bar, unsigned int is_active) {
-    if (!bar) return;
+/* Only the block's own component is reshaped, the others and the status are left alone. */
+int bar_set_block(struct Bar *bar, int index, const char *text) {
+    if (!bar || index < 0 || index >= bar->blocks_length) return 0;
 
-    bar->active = is_active;
+    return basic_component_set_text(bar->blocks[index], bar->pipeline->layouts, text);
 }
 
-void bar_set_floating(struct Bar *bar, unsigned int is_floating) {
-    if (!bar) return;
+int bar_set_floating(struct Bar *bar, unsigned int is_floating) {
+    if (!bar || bar->floating == is_floating) return 0;
 
     bar->floating = is_floating;
+    bar->title->dirty = 1;
+    return 1;
 }
 
-void bar_set_layout(struct Bar *bar, const char *text) {
-    if (!bar) return;
+int bar_set_layout(struct Bar *bar, const char *text) {
+    if (!bar) return 0;
 
-    pango_layout_set_text(bar->layout->layout, text, -1);
+    return basic_component_set_text(bar->layout, bar->pipeline->layouts, text);
 }
 
-void bar_set_status(struct Bar *bar, const char *text) {
-    if (!bar) return;
+int bar_set_status(struct Bar *bar, const char *text) {
+    if (!bar) return 0;
+
+    int was_grid = bar->grid.active, changed = bar_grid_set(bar, text);
+    if (changed != -1)
+        return changed;
 
-    pango_layout_set_text(bar->status->layout, text, -1);
+    return basic_component_set_text(bar->status, bar->pipeline->layouts, text) || was_grid;
 }
 
-void bar_set_tag(struct Bar *bar, unsigned int index,
+int bar_set_tag(struct Bar *bar, unsigned int index,
         unsigned int state, unsigned int occupied, unsigned int has_focused) {
-    if (!bar) return;
-
-    if (!bar || index >= LENGTH(bar->tags) ) return;
+    if (!bar || index >= LENGTH(bar->tags)) return 0;
 
     struct Tag *tag = &bar->tags[index];
+    if (tag->has_focused == has_focused && tag->occupied == occupied && tag->state == state)
+        return 0;
+
     tag->has_focused = has_focused;
     tag->occupied = occupied;
     tag->state = state;
+    tag->component->dirty = 1;
+    return 1;
 }
 
-void bar_set_title(struct Bar *bar, const char *text) {
-    if (!bar) return;
+int bar_set_title(struct Bar *bar, const char *text) {
+    if (!bar) return 0;
 
-    pango_layout_set_text(bar->title->layout, text, -1);
+    return basic_component_set_text(bar->title, bar->pipeline->layouts, text);
 }
 
+/*
+ * Measure pass for the bar. The tags never change width, the layout and status only do so when
+ * their text does, which their cached text widths already account for.
+ * The title takes up whatever is left, ellipsized if it doesn't fit.
+ */
 int bar_width(struct Pipeline *pipeline, void *data, unsigned int future_widths) {
     if (!data || !pipeline) return 0;
 
     struct Bar *bar = data;
-    int width = 0, title_width, status_width;
-
-    for (int i = 0; i < LENGTH(bar->tags); i++)
-        width += bar_component_width(bar->tags[i].component, pipeline);
-    width += bar_component_width(bar->layout, pipeline);
-
-    title_width = pipeline->shm->width - width - bar_component_width(bar->status, pipeline) - future_widths;
-    if (bar_component_width(bar->title, pipeline) > bar->title->width)
-        title_width = bar_component_width(bar->title, pipeline);
-    width += title_width;
-
-    status_width = bar_component_width(bar->status, pipeline);
-    if (status_width > (pipeline->shm->width - width - future_widths)) {
-        char *previous_status = strdup(pango_layout_get_text(bar->status->layout));
-        bar->status->width = bar_component_add_elipses(bar->status, pipeline,
-                (pipeline->shm->width - width - pipeline_get_future_widths(pipeline)));
-        pango_layout_set_text(bar->status->layout, previous_status, -1);
-        free(previous_status);
+    int width, title_width;
+
+    /* Text past what could be shown on an output this wide isn't worth shaping. */
+    size_t max_chars = pipeline->shm->width / (pipeline->font->approx_width > 2 ? pipeline->font->approx_width / 2 : 1);
+    basic_component_set_max_chars(bar->title, pipeline->layouts, max_chars);
+    /* The grid's text isn't in the status layout, it's cut when the grid hands the status back. */
+    if (bar->grid.active)
+        bar->status->max_chars = max_chars;
+    else
+        basic_component_set_max_chars(bar->status, pipeline->layouts, max_chars);
+
+    if (status_atlas && !bar->grid.measured)
+        bar_grid_measure(pipeline, bar);
+
+    bar->layout->width = bar_component_width(bar->layout, pipeline);
+    if (bar->grid.unfit_width && bar->grid.unfit_width != pipeline->shm->width)
+        bar->grid.unfit_width = 0;
+
+    bar->status->width = bar_status_width(pipeline, bar);
+    bar_blocks_width(pipeline, bar);
+    width = bar->tags_width + bar->layout->width + bar->status->width + bar->blocks_width;
+
+    /* The grid can't ellipsize, a status that doesn't fit has to be shaped after all. */
+    if (bar->grid.active && width + future_widths > pipeline->shm->width) {
+        bar->grid.unfit_length = bar->grid.length;
+        bar->grid.unfit_width = pipeline->shm->width;
+        bar_grid_deactivate(bar);
+        basic_component_set_text(bar->status, pipeline->layouts, bar->grid.text);
+        width -= bar->status->width;
+        bar->status->width = bar_component_width(bar->status, pipeline);
+        width += bar->status->width;
     }
-    width += status_width;
 
-    return width;
+    title_width = pipeline->shm->width - width - future_widths;
+    if (title_width < 0)
+        title_width = 0;
+
+    /* Measuring runs on the main thread, anything shaped or pre-rendered is done here rather than while rendering. */
+    bar_fit(pipeline, bar, title_width, future_widths);
+    bar_tiles_prepare(pipeline, bar);
+
+    return width + title_width;
 }
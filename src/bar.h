@@ -10,29 +10,80 @@ enum TagState {
   Tag_Urgent = 2,
 };
 
+enum TagIndicator {
+  Indicator_None,     /* No clients */
+  Indicator_Occupied, /* Has clients, none focused */
+  Indicator_Focused,  /* Has the focused client */
+  Indicator_Last,
+};
+
 struct Tag {
     unsigned int occupied, has_focused, state;
     struct BasicComponent *component;
+    /* The tag pre-rendered in every look it can have, built as they are needed. */
+    cairo_surface_t *tiles[LENGTH(schemes)][Indicator_Last];
+};
+
+/* First and last characters in a glyph atlas, printable ASCII. */
+#define ATLAS_FIRST ' '
+#define ATLAS_LAST  '~'
+#define ATLAS_GLYPHS (ATLAS_LAST - ATLAS_FIRST + 1)
+
+/* Every glyph in the atlas drawn side by side in one color scheme, each one cell wide. */
+struct GlyphAtlas {
+    cairo_surface_t *glyphs;
+    int foreground[4], background[4], height;
+};
+
+/*
+ * The status as a grid of monospace cells, drawn by copying glyphs out of an atlas.
+ * Only cells whose character changed are copied again, anything else goes through Pango.
+ */
+struct StatusGrid {
+    PangoLayout *charset; /* Every glyph in the atlas, shaped once without ligatures */
+    PangoFontDescription *description; /* From status_atlas_font, NULL if the bar font is used */
+    int measured, cell_width /* 0 if the font can't be drawn as a grid */;
+
+    int active; /* The status is being drawn from the grid rather than the component's layout */
+    /* The status didn't fit at this length and bar width, the grid stays off until either changes. */
+    size_t unfit_length;
+    int unfit_width;
+    char *text, *drawn /* What the buffer holds */;
+    size_t length, drawn_length, capacity;
+    const struct GlyphAtlas *drawn_atlas;
+
+    struct GlyphAtlas atlases[2]; /* The status is drawn in at most two schemes, see status_on_active */
+    int next_atlas;
 };
 
 struct Bar {
     struct Pipeline *pipeline;
+    struct Hotspot *hotspot;
     struct BasicComponent *layout, *title, *status;
+    /* Status blocks from the modules after the status, each reshaped only when its own text changes. */
+    struct BasicComponent *blocks[LENGTH(status_blocks)], *separators[LENGTH(status_blocks)];
+    int blocks_length, blocks_width;
     struct Tag tags[LENGTH(tags)];
+    struct StatusGrid grid;
 
     unsigned int active, floating;
-    unsigned int x, y;
+    int tags_width;
+
+    /* What the tag tiles were rendered with, they are rebuilt if either changes. */
+    const struct Font *tiles_font;
+    int tiles_height;
 };
 
 struct Bar *bar_create(struct List *hotspots, struct Pipeline *pipeline);
 void bar_destroy(struct Bar *bar);
-void bar_set_active(struct Bar *bar, unsigned int is_active);
-void bar_set_floating(struct Bar *bar, unsigned int is_floating);
-void bar_set_layout(struct Bar *bar, const char *text);
-void bar_set_status(struct Bar *bar, const char *text);
-void bar_set_tag(struct Bar *bar, unsigned int index,
+int bar_set_active(struct Bar *bar, unsigned int is_active);
+int bar_set_block(struct Bar *bar, int index, const char *text);
+int bar_set_floating(struct Bar *bar, unsigned int is_floating);
+int bar_set_layout(struct Bar *bar, const char *text);
+int bar_set_status(struct Bar *bar, const char *text);
+int bar_set_tag(struct Bar *bar, unsigned int index,
         unsigned int state, unsigned int occupied, unsigned int focusedClient);
-void bar_set_title(struct Bar *bar, const char *text);
+int bar_set_title(struct Bar *bar, const char *text);
 
 extern const struct PipelineListener bar_pipeline_listener;
 
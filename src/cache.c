@@ -0,0 +1,118 @@
+#include "cache.h"
+#include "util.h"
+#include <string.h>
+
+static void entry_destroy(struct LayoutCacheEntry *entry);
+static struct LayoutCacheEntry **entry_slot(struct LayoutCache *cache, struct LayoutCacheEntry *entry);
+static void layout_cache_evict(struct LayoutCache *cache);
+
+void entry_destroy(struct LayoutCacheEntry *entry) {
+    if (!entry) return;
+
+    g_object_unref(entry->layout);
+    pango_font_description_free(entry->description);
+    free(entry->text);
+    free(entry);
+}
+
+/* Find the pointer that points at `entry` inside of its bucket chain. */
+struct LayoutCacheEntry **entry_slot(struct LayoutCache *cache, struct LayoutCacheEntry *entry) {
+    struct LayoutCacheEntry **slot = &cache->buckets[entry->hash & (cache->bucket_count - 1)];
+    while (*slot && *slot != entry)
+        slot = &(*slot)->next;
+    return slot;
+}
+
+struct LayoutCache *layout_cache_create(PangoContext *context, size_t capacity) {
+    if (!context)
+        return NULL;
+
+    struct LayoutCache *cache = ecalloc(1, sizeof(*cache));
+    cache->context = context;
+    cache->capacity = capacity > 0 ? capacity : 1;
+    cache->length = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+
+    /* Power of two so a bucket is just a mask of the hash, at most half full. */
+    for (cache->bucket_count = 8; cache->bucket_count < cache->capacity * 2; cache->bucket_count *= 2);
+    cache->buckets = ecalloc(cache->bucket_count, sizeof(*cache->buckets));
+    wl_list_init(&cache->lru);
+
+    return cache;
+}
+
+void layout_cache_destroy(struct LayoutCache *cache) {
+    if (!cache)
+        return;
+
+    struct LayoutCacheEntry *entry, *tmp;
+    wl_list_for_each_safe(entry, tmp, &cache->lru, link)
+        entry_destroy(entry);
+    free(cache->buckets);
+    free(cache);
+}
+
+void layout_cache_evict(struct LayoutCache *cache) {
+    if (wl_list_empty(&cache->lru))
+        return;
+
+    struct LayoutCacheEntry *entry = wl_container_of(cache->lru.prev, entry, link);
+    struct LayoutCacheEntry **slot = entry_slot(cache, entry);
+    *slot = entry->next;
+    wl_list_remove(&entry->link);
+    entry_destroy(entry);
+    cache->length--;
+}
+
+/*
+ * Returns a shaped layout for the first `length` bytes of `text` in the font `description`,
+ * along with its pixel width.
+ * The caller gets its own reference to the layout and must not change its text or attributes,
+ * as other users may be sharing it.
+ */
+PangoLayout *layout_cache_get(struct LayoutCache *cache, const PangoFontDescription *description,
+        const char *text, size_t length, int *width) {
+    if (!cache || !description || !text)
+        return NULL;
+
+    uint32_t hash = string_hash(text, length) ^ pango_font_description_hash(description);
+    struct LayoutCacheEntry *entry, **bucket = &cache->buckets[hash & (cache->bucket_count - 1)];
+
+    for (entry = *bucket; entry; entry = entry->next) {
+        if (entry->hash != hash || !STRINGN_EQUAL(entry->text, text, length) || entry->text[length]
+                || !pango_font_description_equal(entry->description, description))
+            continue;
+
+        cache->hits++;
+        wl_list_remove(&entry->link);
+        wl_list_insert(&cache->lru, &entry->link);
+        if (width)
+            *width = entry->width;
+        return g_object_ref(entry->layout);
+    }
+
+    cache->misses++;
+    if (cache->length >= cache->capacity)
+        layout_cache_evict(cache);
+
+    entry = ecalloc(1, sizeof(*entry));
+    entry->hash = hash;
+    entry->text = strndup(text, length);
+    entry->description = pango_font_description_copy(description);
+    entry->layout = pango_layout_new(cache->context);
+    pango_layout_set_font_description(entry->layout, description);
+    pango_layout_set_text(entry->layout, text, length);
+    pango_layout_get_size(entry->layout, &entry->width, NULL);
+    entry->width = PANGO_PIXELS(entry->width);
+
+    /* Bucket may have been changed by the eviction. */
+    entry->next = cache->buckets[hash & (cache->bucket_count - 1)];
+    cache->buckets[hash & (cache->bucket_count - 1)] = entry;
+    wl_list_insert(&cache->lru, &entry->link);
+    cache->length++;
+
+    if (width)
+        *width = entry->width;
+    return g_object_ref(entry->layout);
+}
@@ -0,0 +1,35 @@
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stdint.h>
+#include <pango/pango.h>
+#include <wayland-util.h>
+
+/* A shaped layout, keyed by its text and font description. */
+struct LayoutCacheEntry {
+    uint32_t hash;
+    char *text;
+    PangoFontDescription *description;
+    PangoLayout *layout;
+    int width; /* Pixel width of the text */
+
+    struct LayoutCacheEntry *next; /* Next entry in the same bucket */
+    struct wl_list link; /* Position in the LRU list */
+};
+
+/* Bounded LRU cache of shaped layouts so revisited strings don't have to be reshaped. */
+struct LayoutCache {
+    PangoContext *context;
+    struct LayoutCacheEntry **buckets;
+    size_t bucket_count, length, capacity;
+    struct wl_list lru; /* struct LayoutCacheEntry*, most recently used first */
+
+    unsigned long hits, misses;
+};
+
+struct LayoutCache *layout_cache_create(PangoContext *context, size_t capacity);
+void layout_cache_destroy(struct LayoutCache *cache);
+PangoLayout *layout_cache_get(struct LayoutCache *cache, const PangoFontDescription *description,
+        const char *text, size_t length, int *width);
+
+#endif // CACHE_H_
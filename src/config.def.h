@@ -9,6 +9,14 @@ static const int bar_top = 1;          /* Boolean value, non-zero is true. If no
 static const int status_on_active = 1; /* Display the status on active monitor only. If not then on all. */
 static const char *font = "Monospace 10";
 static const char *terminal[] = { "alacritty", NULL };
+static const unsigned int layout_cache_size = 64; /* Shaped text layouts kept around for reuse, shared by every bar. */
+static const unsigned int max_fps = 30;           /* Most times per second a bar will redraw. */
+static const unsigned int coalesce_delay = 8;     /* Milliseconds to wait for more updates before redrawing. */
+static const unsigned int render_threads = 0;     /* Extra threads drawing bars in parallel, 0 draws every bar on the main thread. */
+static const int status_atlas = 0;                /* Draw plain ASCII status text from pre-rendered glyphs, only used if the font is monospace. */
+static const char *status_atlas_font = NULL;      /* Monospace font for those glyphs, best the same size as font. NULL uses font. */
+static const unsigned int max_line_length = 4096; /* Longest line read from stdin or the fifo, longer ones are dropped. */
+static const unsigned int commit_deadline = 4;    /* Milliseconds lines from dwl are held at most before being applied. */
 
 /*
  * Colors:
@@ -39,6 +47,22 @@ static const int *schemes[3][2] = {
  */
 static const char *tags[] = { "1", "2", "3", "4", "5", "6", "7", "8", "9" };
 
+/*
+ * Status blocks
+ * Built in instead of status scripts, shown after whatever status comes from the fifo or socket.
+ * Only used if status_modules is non-zero.
+ */
+static const int status_modules = 0;
+static const char *status_separator = " | ";
+static const struct StatusBlock status_blocks[] = {
+    /* module,        interval,  argument,  device */
+    { Module_Load,    5000,      "load " },
+    { Module_Cpu,     2000,      "cpu " },
+    { Module_Memory,  5000,      "mem " },
+    { Module_Battery, 30000,     "bat ",    "BAT0" },
+    { Module_Clock,   1000,      "%a %d %b %H:%M:%S" },
+};
+
 /*
  * Buttons
  * See user.h for details on relevant structures.
@@ -1,33 +1,72 @@
 #include "event.h"
+#include "log.h"
+#include "main.h"
 #include "util.h"
+#include <errno.h>
 #include <poll.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/* Most ready sources handled per epoll_wait */
+#define EVENTS_BATCH 32
+
+static uint32_t mask_to_epoll(short mask);
+static short mask_from_epoll(uint32_t mask);
+static void signals_in(int fd, short mask, void *data);
+static void timer_in(int fd, short mask, void *data);
 
 void events_add(struct Events *events, int fd, short mask, void *data,
         void (*callback)(int, short, void *)) {
-    if (!events)
+    if (!events || fd < 0)
         return;
 
-    if (events->pollfds_length == events->pollfds_capacity) {
-        events->pollfds = realloc(events->pollfds, sizeof(struct pollfd) * (events->pollfds_capacity+1));
-        events->pollfds_capacity++;
+    if (fd >= events->callbacks_capacity) {
+        int capacity = events->callbacks_capacity ? events->callbacks_capacity : 16;
+        while (capacity <= fd)
+            capacity *= 2;
+        if (!(events->callbacks = realloc(events->callbacks, capacity * sizeof(*events->callbacks))))
+            panic("realloc");
+        memset(events->callbacks + events->callbacks_capacity, 0,
+                (capacity - events->callbacks_capacity) * sizeof(*events->callbacks));
+        events->callbacks_capacity = capacity;
     }
-    events->pollfds[events->pollfds_length++] = (struct pollfd){fd, mask, 0};
+    if (events->callbacks[fd])
+        events_remove(events, fd);
 
-    struct EventCallback *backcall = list_add(events->callbacks, ecalloc(1, sizeof(*backcall)));
+    struct EventCallback *backcall = ecalloc(1, sizeof(*backcall));
+    backcall->fd = fd;
     backcall->callback = callback;
     backcall->data = data;
+    events->callbacks[fd] = backcall;
+
+    struct epoll_event event = { .events = mask_to_epoll(mask), .data.ptr = backcall };
+    if (epoll_ctl(events->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        if (errno != EPERM)
+            panic("epoll_ctl add %d", fd);
+
+        /* Regular files are always readable, poll would have said so every time too. */
+        backcall->always_ready = 1;
+        backcall->next = events->always_ready;
+        events->always_ready = backcall;
+    }
 }
 
 struct Events *events_create(void) {
     struct Events *events = ecalloc(1, sizeof(*events));
 
-    events->callbacks = list_create(0);
-    events->pollfds = NULL;
-    events->pollfds_length = 0;
-    events->pollfds_capacity = 0;
+    events->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (events->epoll_fd < 0)
+        panic("epoll_create1");
+    events->callbacks = NULL;
+    events->callbacks_capacity = 0;
+    events->removed = NULL;
+    events->always_ready = NULL;
+    events->signal_fd = -1;
+    sigemptyset(&events->signals);
 
     return events;
 }
@@ -36,40 +75,173 @@ void events_destroy(struct Events *events) {
     if (!events)
         return;
 
-    list_elements_destroy(events->callbacks, free);
-    free(events->pollfds);
+    if (events->signal_fd >= 0) {
+        events_remove(events, events->signal_fd);
+        close(events->signal_fd);
+    }
+    for (int i = 0; i < events->callbacks_capacity; i++)
+        if (events->callbacks[i])
+            events_remove(events, i);
+    while (events->removed) {
+        struct EventCallback *next = events->removed->next;
+        free(events->removed);
+        events->removed = next;
+    }
+
+    close(events->epoll_fd);
+    free(events->callbacks);
     free(events);
 }
 
+/* Changes what a source is woken up for. */
+void events_modify(struct Events *events, int fd, short mask) {
+    if (!events || fd < 0 || fd >= events->callbacks_capacity || !events->callbacks[fd])
+        return;
+
+    struct EventCallback *backcall = events->callbacks[fd];
+    if (backcall->always_ready)
+        return;
+
+    struct epoll_event event = { .events = mask_to_epoll(mask), .data.ptr = backcall };
+    if (epoll_ctl(events->epoll_fd, EPOLL_CTL_MOD, fd, &event) < 0)
+        panic("epoll_ctl mod %d", fd);
+}
+
+/* Waits for and dispatches one batch of ready sources. Sources may be added or removed by the callbacks. */
 void events_poll(struct Events *events) {
     if (!events)
         return;
 
-    if (poll(events->pollfds, events->pollfds_length, -1) <= 0)
-        return;
+    /* Files that are always ready are read on every pass, so nothing blocks until they are removed. */
+    struct epoll_event ready[EVENTS_BATCH];
+    int length = epoll_wait(events->epoll_fd, ready, LENGTH(ready), events->always_ready ? 0 : -1);
+    if (length < 0 && errno != EINTR)
+        panic("epoll_wait");
 
-    for (int i = 0; i < events->pollfds_length; i++) {
-        struct pollfd *pollfd = &events->pollfds[i];
-        struct EventCallback *callback = events->callbacks->data[i];
+    for (int i = 0; i < length; i++) {
+        struct EventCallback *backcall = ready[i].data.ptr;
+        if (!backcall->removed)
+            backcall->callback(backcall->fd, mask_from_epoll(ready[i].events), backcall->data);
+    }
 
+    /* next is taken first, the callback may remove its own source. */
+    for (struct EventCallback *backcall = events->always_ready, *next; backcall; backcall = next) {
+        next = backcall->next;
+        if (!backcall->removed)
+            backcall->callback(backcall->fd, POLLIN, backcall->data);
+    }
 
-        if (pollfd->revents & (pollfd->events | POLLHUP | POLLERR))
-            callback->callback(pollfd->fd, pollfd->revents, callback->data);
+    while (events->removed) {
+        struct EventCallback *next = events->removed->next;
+        free(events->removed);
+        events->removed = next;
     }
 }
 
+/* Safe from inside a callback, the source is only freed once the current batch is dispatched. */
 void events_remove(struct Events *events, int fd) {
+    if (!events || fd < 0 || fd >= events->callbacks_capacity || !events->callbacks[fd])
+        return;
+
+    struct EventCallback *backcall = events->callbacks[fd];
+    events->callbacks[fd] = NULL;
+
+    if (backcall->always_ready) {
+        struct EventCallback **slot = &events->always_ready;
+        while (*slot != backcall)
+            slot = &(*slot)->next;
+        *slot = backcall->next;
+    } else if (epoll_ctl(events->epoll_fd, EPOLL_CTL_DEL, fd, NULL) < 0 && errno != EBADF) {
+        bar_log(LOG_ERROR, "epoll_ctl del %d: %s", fd, strerror(errno));
+    }
+
+    backcall->removed = 1;
+    backcall->next = events->removed;
+    events->removed = backcall;
+}
+
+/* The signal is blocked and read through a signalfd from then on, threads started later inherit the block. */
+void events_signal_add(struct Events *events, int signal, void *data, void (*callback)(int signal, void *data)) {
+    if (!events || signal <= 0 || signal >= NSIG)
+        return;
+
+    events->signal_handlers[signal] = (struct EventSignal){ .callback = callback, .data = data };
+    sigaddset(&events->signals, signal);
+    if (sigprocmask(SIG_BLOCK, &events->signals, NULL) < 0)
+        panic("sigprocmask");
+
+    int first = events->signal_fd < 0;
+    events->signal_fd = signalfd(events->signal_fd, &events->signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (events->signal_fd < 0)
+        panic("signalfd");
+    if (first)
+        events_add(events, events->signal_fd, POLLIN, events, signals_in);
+}
+
+struct EventTimer *events_timer_add(struct Events *events, void *data, void (*callback)(void *data)) {
     if (!events)
+        return NULL;
+
+    struct EventTimer *timer = ecalloc(1, sizeof(*timer));
+    timer->callback = callback;
+    timer->data = data;
+    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer->fd < 0)
+        panic("timerfd_create");
+
+    events_add(events, timer->fd, POLLIN, timer, timer_in);
+    return timer;
+}
+
+void events_timer_remove(struct Events *events, struct EventTimer *timer) {
+    if (!timer)
         return;
 
-    for (int i = 0; i < events->pollfds_length; i++) {
-        if (events->pollfds[i].fd != fd)
-            continue;
+    events_remove(events, timer->fd);
+    close(timer->fd);
+    free(timer);
+}
 
-        free(list_remove(events->callbacks, i));
+/* Fires after delay milliseconds, then every interval milliseconds if that isn't 0. A delay of 0 disarms it. */
+void events_timer_set(struct EventTimer *timer, uint64_t delay, uint64_t interval) {
+    if (!timer)
+        return;
 
-        events->pollfds_length--;
-        memmove(&events->pollfds[i], &events->pollfds[i+1],
-                sizeof(struct pollfd) * (events->pollfds_length - i));
+    struct itimerspec spec = {
+        .it_value = { .tv_sec = delay / 1000, .tv_nsec = (delay % 1000) * 1000000 },
+        .it_interval = { .tv_sec = interval / 1000, .tv_nsec = (interval % 1000) * 1000000 },
+    };
+    if (timerfd_settime(timer->fd, 0, &spec, NULL) < 0)
+        panic("timerfd_settime");
+}
+
+uint32_t mask_to_epoll(short mask) {
+    return (mask & POLLIN ? EPOLLIN : 0) | (mask & POLLOUT ? EPOLLOUT : 0) | (mask & POLLPRI ? EPOLLPRI : 0);
+}
+
+short mask_from_epoll(uint32_t mask) {
+    return (mask & EPOLLIN ? POLLIN : 0) | (mask & EPOLLOUT ? POLLOUT : 0) | (mask & EPOLLPRI ? POLLPRI : 0)
+        | (mask & EPOLLERR ? POLLERR : 0) | (mask & EPOLLHUP ? POLLHUP : 0);
+}
+
+void signals_in(int fd, short mask, void *data) {
+    struct Events *events = data;
+    struct signalfd_siginfo info;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        const struct EventSignal *handler = &events->signal_handlers[info.ssi_signo < NSIG ? info.ssi_signo : 0];
+        if (handler->callback)
+            handler->callback(info.ssi_signo, handler->data);
     }
 }
+
+void timer_in(int fd, short mask, void *data) {
+    struct EventTimer *timer = data;
+    uint64_t expirations;
+
+    /* Nothing to read means it was set again since it fired. */
+    if (read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+        return;
+
+    timer->callback(timer->data);
+}
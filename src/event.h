@@ -1,22 +1,51 @@
 #ifndef EVENT_H_
 #define EVENT_H_
 #include "util.h"
+#include <signal.h>
+#include <stdint.h>
 
+/* Sources are given and report poll(2) masks, POLLIN, POLLOUT, POLLHUP and POLLERR. */
 struct EventCallback {
+    int fd;
     void (*callback)(int fd, short mask, void *data);
     void *data;
+
+    int removed; /* Removed while dispatching, freed once dispatching is done */
+    int always_ready; /* A file epoll can't watch, such as a regular file on stdin, removed by its owner at end of file */
+    struct EventCallback *next; /* In the removed or always ready list */
+};
+
+struct EventTimer {
+    int fd;
+    void (*callback)(void *data);
+    void *data;
+};
+
+struct EventSignal {
+    void (*callback)(int signal, void *data);
+    void *data;
 };
 
 struct Events {
-    struct List *callbacks; // struct EventCallback*
-    struct pollfd *pollfds;
-    int pollfds_length, pollfds_capacity;
+    int epoll_fd;
+    struct EventCallback **callbacks; /* Indexed by fd */
+    int callbacks_capacity;
+    struct EventCallback *removed, *always_ready;
+
+    int signal_fd;
+    sigset_t signals;
+    struct EventSignal signal_handlers[NSIG];
 };
 
 void events_add(struct Events *events, int fd, short mask, void *data, void (*callback)(int fd, short mask, void *data));
 struct Events *events_create(void);
 void events_destroy(struct Events *events);
+void events_modify(struct Events *events, int fd, short mask);
 void events_poll(struct Events *events);
 void events_remove(struct Events *events, int fd);
+void events_signal_add(struct Events *events, int signal, void *data, void (*callback)(int signal, void *data));
+struct EventTimer *events_timer_add(struct Events *events, void *data, void (*callback)(void *data));
+void events_timer_remove(struct Events *events, struct EventTimer *timer);
+void events_timer_set(struct EventTimer *timer, uint64_t delay, uint64_t interval);
 
 #endif // EVENT_H_
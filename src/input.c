@@ -1,6 +1,7 @@
 #include "input.h"
 #include "log.h"
 #include "main.h"
+#include "record.h"
 #include "user.h"
 #include "util.h"
 #include "render.h"
@@ -14,12 +15,14 @@
 #include <wayland-cursor.h>
 #include <wayland-util.h>
 
-static int button_cmp(const void *left, const void *right);
 static void hotspots_process(struct Monitor* monitor, double x, double y, uint32_t button);
 static void pointer_axis(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value);
 static void pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete);
 static void pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source);
 static void pointer_axis_stop(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis);
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+static void pointer_axis_value120(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t value120);
+#endif
 static void pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state);
 static struct Pointer *pointer_create(struct wl_seat *seat);
 static void pointer_destroy(struct Pointer *pointer);
@@ -44,11 +47,14 @@ static void touch_shape(void *data, struct wl_touch *wl_touch, int32_t id, wl_fi
 static void touch_up(void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time, int32_t id);
 static uint32_t wl_axis_to_button(int axis, wl_fixed_t value);
 
-static const struct wl_pointer_listener pointer_listener = {
+const struct wl_pointer_listener pointer_listener = {
     .axis = pointer_axis,
     .axis_discrete = pointer_axis_discrete,
     .axis_source = pointer_axis_source,
     .axis_stop = pointer_axis_stop,
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+    .axis_value120 = pointer_axis_value120,
+#endif
     .button = pointer_button,
     .enter = pointer_enter,
     .frame = pointer_frame,
@@ -61,7 +67,7 @@ const struct wl_seat_listener seat_listener = {
     .name = seat_name,
 };
 
-static const struct wl_touch_listener touch_listener = {
+const struct wl_touch_listener touch_listener = {
     .cancel = touch_cancel,
     .down = touch_down,
     .frame = touch_frame,
@@ -71,17 +77,16 @@ static const struct wl_touch_listener touch_listener = {
     .up = touch_up,
 };
 
-int button_cmp(const void *left, const void *right) {
-    return (*(uint32_t*)left) == (*(uint32_t*)right);
-}
-
 void pointer_axis(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis_index, wl_fixed_t value) {
     struct Pointer *pointer = data;
     struct Axis *axis = &pointer->axis[axis_index];
 
-    if (axis->discrete_steps == 0
-            && time - axis->update_time - SCROLL_TIMEOUT)
-        axis->value = 0;
+    if (time - axis->update_time > SCROLL_TIMEOUT) {
+        if (axis->discrete_steps == 0)
+            axis->value = 0;
+        /* A part of a notch from long ago doesn't add up with new movement. */
+        axis->value120 = 0;
+    }
 
     axis->value += value;
     axis->update_time = time;
@@ -95,6 +100,21 @@ void pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t a
     pointer->scrolled = 1;
 }
 
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+/*
+ * Sent instead of axis_discrete since wl_seat version 8, a notch is 120 and high resolution wheels send fractions of it.
+ * Counted when the frame ends, after axis had the chance to time out what is left of older movement.
+ */
+void pointer_axis_value120(void *data, struct wl_pointer *wl_pointer, uint32_t axis_index, int32_t value120) {
+    struct Pointer *pointer = data;
+    struct Axis *axis = &pointer->axis[axis_index];
+
+    axis->frame_value120 += value120;
+    axis->wheel = 1;
+    pointer->scrolled = 1;
+}
+#endif
+
 void pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source) {
     /* Nop */
 }
@@ -107,14 +127,15 @@ void pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial,
     struct Pointer *pointer = data;
     int index;
 
-    if (state == WL_POINTER_BUTTON_STATE_PRESSED && list_cmp_find(pointer->buttons, &button, button_cmp) == -1) {
-        uint32_t *btn = list_add(pointer->buttons, ecalloc(1, sizeof(*btn)));
-        *btn = button;
-    }
-    else if (state == WL_POINTER_BUTTON_STATE_RELEASED &&
-            (index = list_cmp_find(pointer->buttons, &button, button_cmp)) != -1) {
-        free(list_remove(pointer->buttons, index));
-    }
+    for (index = 0; index < pointer->buttons_length; index++)
+        if (pointer->buttons[index] == button)
+            break;
+
+    if (state == WL_POINTER_BUTTON_STATE_PRESSED && index == pointer->buttons_length
+            && pointer->buttons_length < POINTER_BUTTONS)
+        pointer->buttons[pointer->buttons_length++] = button;
+    else if (state == WL_POINTER_BUTTON_STATE_RELEASED && index < pointer->buttons_length)
+        pointer->buttons[index] = pointer->buttons[--pointer->buttons_length];
 }
 
 struct Pointer *pointer_create(struct wl_seat *seat) {
@@ -123,7 +144,7 @@ struct Pointer *pointer_create(struct wl_seat *seat) {
     struct Pointer *pointer = ecalloc(1, sizeof(*pointer));
     pointer->pointer = wl_seat_get_pointer(seat);
     pointer->scrolled = 0;
-    pointer->buttons = list_create(0);
+    pointer->buttons_length = 0;
     pointer->focused_monitor = NULL;
     pointer->cursor_surface = NULL;
     pointer->cursor_image = NULL;
@@ -138,14 +159,14 @@ void pointer_destroy(struct Pointer *pointer) {
     wl_pointer_release(pointer->pointer);
     wl_surface_destroy(pointer->cursor_surface);
     wl_cursor_theme_destroy(pointer->cursor_theme);
-    list_elements_destroy(pointer->buttons, free);
     free(pointer);
 }
 
 void pointer_enter(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y) {
     struct Pointer *pointer = data;
     pointer->focused_monitor = monitor_from_surface(surface);
-    if (!pointer->focused_monitor)
+    /* Replayed events come without a pointer, there is no cursor to set. */
+    if (!pointer->focused_monitor || !wl_pointer)
         return;
 
     pointer_update_cursor(pointer);
@@ -158,21 +179,32 @@ void pointer_frame(void *data, struct wl_pointer *wl_pointer) {
     struct Monitor *monitor = pointer->focused_monitor;
     if (!monitor) return;
 
-    for (int i = 0; i < pointer->buttons->length; i++)
-        hotspots_process(pointer->focused_monitor, pointer->x, pointer->y,
-                *(uint32_t*)pointer->buttons->data[i]);
-    list_elements_destroy(pointer->buttons, free);
-    pointer->buttons = list_create(0);
+    for (int i = 0; i < pointer->buttons_length; i++)
+        hotspots_process(pointer->focused_monitor, pointer->x, pointer->y, pointer->buttons[i]);
+    pointer->buttons_length = 0;
 
     if (pointer->scrolled) {
         for (int i = 0; i < 2; i++)
             pointer_process_scroll(pointer, i);
+        pointer->scrolled = 0;
     }
 }
 
 void pointer_process_scroll(struct Pointer *pointer, unsigned int axis_index) {
     struct Axis *axis = &pointer->axis[axis_index];
-    if (axis->discrete_steps) {
+    if (axis->wheel) {
+        /* Only whole notches scroll, the continuous value of the same frame would scroll a second time. */
+        axis->value120 += axis->frame_value120;
+        int steps = abs(axis->value120) / SCROLL_VALUE120;
+        uint32_t button = wl_axis_to_button(axis_index, axis->value120 < 0 ? -1 : 1);
+        axis->value120 %= SCROLL_VALUE120;
+        for (int i = 0; i < steps; i++)
+            hotspots_process(pointer->focused_monitor, pointer->x, pointer->y, button);
+        axis->frame_value120 = 0;
+        axis->wheel = 0;
+        axis->value = 0;
+        axis->discrete_steps = 0;
+    } else if (axis->discrete_steps) {
         for (int i = 0; i < axis->discrete_steps; i++)
             hotspots_process(pointer->focused_monitor, pointer->x, pointer->y, wl_axis_to_button(axis_index, axis->value));
         axis->value = 0;
@@ -193,6 +225,11 @@ void pointer_process_scroll(struct Pointer *pointer, unsigned int axis_index) {
 void pointer_leave(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface) {
     struct Pointer *pointer = data;
     pointer->focused_monitor = NULL;
+
+    /* Scrolling elsewhere doesn't carry over to the next time the pointer is on a bar. */
+    for (int i = 0; i < LENGTH(pointer->axis); i++)
+        pointer->axis[i] = (struct Axis){ .update_time = pointer->axis[i].update_time };
+    pointer->scrolled = 0;
 }
 
 void pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
@@ -208,8 +245,9 @@ void pointer_update_cursor(struct Pointer *pointer) {
     if (!pointer->cursor_surface)
         pointer->cursor_surface = wl_compositor_create_surface(compositor);
 
+    /* The theme is loaded once, reloading it on every enter allocates */
     if (pointer->cursor_theme)
-        wl_cursor_theme_destroy(pointer->cursor_theme);
+        return;
 
     unsigned int cursor_size = 24;
     const char *cursor_theme = getenv("XCURSOR_THEME");
@@ -228,20 +266,15 @@ void pointer_update_cursor(struct Pointer *pointer) {
 }
 
 void hotspots_process(struct Monitor* monitor, double x, double y, uint32_t button) {
-    struct Hotspot *hotspot;
-    for (int i = 0; i < monitor->hotspots->length; i++) {
-        hotspot = monitor->hotspots->data[i];
-
-        double hotspot_x = 0, hotspot_y = 0, hotspot_width = 0, hotspot_height = 0;
-        hotspot->listener->bounds(hotspot->data, &hotspot_x, &hotspot_y, &hotspot_width, &hotspot_height);
-
-        if (!( x > hotspot_x && y > hotspot_y &&
-                    x < (hotspot_x+hotspot_width) && y < (hotspot_y+hotspot_height)))
-            continue;
+    if (!monitor || !monitor->pipeline->shm || y < 0 || y >= monitor->pipeline->shm->height)
+        return;
 
-        hotspot->listener->click(monitor, hotspot->data, button, x, y);
+    const struct Region *region = pipeline_region_at(monitor->pipeline, x);
+    if (!region || !region->hotspot)
         return;
-    }
+
+    pipeline_boost(monitor->pipeline);
+    region->hotspot->listener->click(monitor, region->hotspot->data, button, region);
 }
 
 void seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t capabilities) {
@@ -251,7 +284,8 @@ void seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t capabilitie
 
     if (!seat->pointer && has_pointer) {
         seat->pointer = pointer_create(seat->seat);
-        wl_pointer_add_listener(seat->pointer->pointer, &pointer_listener, seat->pointer);
+        wl_pointer_add_listener(seat->pointer->pointer,
+                record_is_active() ? &record_pointer_listener : &pointer_listener, seat->pointer);
     }
     else if (seat->pointer && !has_pointer) {
         pointer_destroy(seat->pointer);
@@ -259,7 +293,8 @@ void seat_capabilities(void *data, struct wl_seat *wl_seat, uint32_t capabilitie
 
     if (!seat->touch && has_touch) {
         seat->touch = touch_create(seat->seat);
-        wl_touch_add_listener(seat->touch->touch, &touch_listener, seat->touch);
+        wl_touch_add_listener(seat->touch->touch,
+                record_is_active() ? &record_touch_listener : &touch_listener, seat->touch);
     }
     else if (seat->touch && !has_touch) {
         touch_destroy(seat->touch);
@@ -324,8 +359,8 @@ void touch_down(void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t
 
     point->id = id;
     point->time = time;
-    point->start_x = wl_fixed_to_double(x);
-    point->start_y = wl_fixed_to_double(y);
+    point->start_x = point->x = wl_fixed_to_double(x);
+    point->start_y = point->y = wl_fixed_to_double(y);
 }
 
 void touch_frame(void *data, struct wl_touch *wl_touch) {
@@ -389,10 +424,12 @@ void touch_shape(void *data, struct wl_touch *wl_touch, int32_t id, wl_fixed_t m
 void touch_up(void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time, int32_t id) {
     struct Touch *touch = data;
     struct TouchPoint *point = touch_get_point(touch, id);
-    if (!point) return;
+    if (!point || !point->focused_monitor) return;
 
     uint32_t button = touch_point_to_button(point, time);
     hotspots_process(point->focused_monitor, point->x, point->y, button);
+    point->id = -1;
+    point->focused_monitor = NULL;
 }
 
 uint32_t wl_axis_to_button(int axis, wl_fixed_t value) {
@@ -2,6 +2,7 @@
 #define INPUT_H_
 
 #include "main.h"
+#include "render.h"
 #include "util.h"
 #include "user.h"
 #include <wayland-util.h>
@@ -9,6 +10,16 @@
 
 #define SCROLL_TIMEOUT 1000
 #define SCROLL_THRESHOLD 10000
+/* One notch of a wheel in axis_value120 units */
+#define SCROLL_VALUE120 120
+/* Most buttons pressed within one pointer frame that are remembered */
+#define POINTER_BUTTONS 8
+/* Highest wl_seat version the listeners handle, 8 adds axis_value120 when the headers know it */
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+#define SEAT_VERSION 8
+#else
+#define SEAT_VERSION 5
+#endif
 
 struct TouchPoint {
     int32_t id;
@@ -25,6 +36,9 @@ struct Touch {
 
 struct Axis {
     wl_fixed_t value;
+    int32_t value120, /* High resolution wheel movement not yet making up a whole notch */
+            frame_value120; /* Wheel movement this frame, added to value120 once the frame ends */
+    int wheel; /* A wheel sent value120 this frame, the continuous value is the same movement again */
     uint32_t discrete_steps, update_time;
 };
 
@@ -37,7 +51,8 @@ struct Pointer {
     struct wl_surface *cursor_surface;
 
     double x, y;
-    struct List *buttons; /* uint32_t* */
+    uint32_t buttons[POINTER_BUTTONS]; /* Pressed since the last frame */
+    int buttons_length;
     struct Axis axis[2];
     int scrolled;
 };
@@ -51,9 +66,9 @@ struct Seat {
     struct wl_list link;
 };
 
+/* Hotspots are found through the regions their owner publishes while rendering, see pipeline_region_add. */
 struct HotspotListener {
-    void (*click)(struct Monitor *monitor, void *data, uint32_t button, double x, double y);
-    void (*bounds)(void *data, double *x, double *y, double *width, double *height);
+    void (*click)(struct Monitor *monitor, void *data, uint32_t button, const struct Region *region);
 };
 
 struct Hotspot {
@@ -61,7 +76,9 @@ struct Hotspot {
     void *data;
 };
 
+extern const struct wl_pointer_listener pointer_listener;
 extern const struct wl_seat_listener seat_listener;
+extern const struct wl_touch_listener touch_listener;
 
 void seat_destroy(struct Seat *seat);
 
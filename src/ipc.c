@@ -0,0 +1,255 @@
+#define _GNU_SOURCE /* accept4 */
+#include "ipc.h"
+#include "log.h"
+#include "main.h"
+#include "util.h"
+#include <errno.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static void ipc_accept(int fd, short mask, void *data);
+static void ipc_client_destroy(struct IpcClient *client);
+static int ipc_client_flush(struct IpcClient *client);
+static void ipc_client_in(int fd, short mask, void *data);
+static int ipc_client_process(struct IpcClient *client);
+static int ipc_message_handle(struct IpcClient *client, char *message, size_t length);
+
+void ipc_accept(int fd, short mask, void *data) {
+    struct IpcServer *server = data;
+    int client_fd;
+
+    while ((client_fd = accept4(fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        struct IpcClient *client = ecalloc(1, sizeof(*client));
+        client->fd = client_fd;
+        client->server = server;
+        client->capacity = 4096;
+        client->buffer = ecalloc(client->capacity, sizeof(*client->buffer));
+
+        wl_list_insert(&server->clients, &client->link);
+        events_add(server->events, client_fd, POLLIN, client, ipc_client_in);
+    }
+
+    if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        bar_log(LOG_ERROR, "ipc accept: %s", strerror(errno));
+}
+
+void ipc_client_destroy(struct IpcClient *client) {
+    events_remove(client->server->events, client->fd);
+    close(client->fd);
+    wl_list_remove(&client->link);
+    free(client->buffer);
+    free(client->reply);
+    free(client);
+}
+
+/* Sends as much of the finished replies as the socket takes, the rest waits for POLLOUT. */
+int ipc_client_flush(struct IpcClient *client) {
+    size_t sent = 0;
+
+    while (sent < client->reply_start) {
+        ssize_t bytes = send(client->fd, client->reply + sent, client->reply_start - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (bytes < 0)
+            return -1;
+        sent += bytes;
+    }
+
+    client->reply_length -= sent;
+    client->reply_start -= sent;
+    if (sent > 0 && client->reply_length > 0)
+        memmove(client->reply, client->reply + sent, client->reply_length);
+
+    /* A client that doesn't read its replies isn't waited on forever. */
+    if (client->reply_start > IPC_MESSAGE_MAX) {
+        bar_log(LOG_ERROR, "ipc client isn't reading its replies");
+        return -1;
+    }
+
+    int blocked = client->reply_start > 0;
+    if (blocked != client->blocked) {
+        client->blocked = blocked;
+        events_modify(client->server->events, client->fd, blocked ? POLLIN | POLLOUT : POLLIN);
+    }
+    return 0;
+}
+
+/* Reads until the socket would block, handling every complete message. Clients are dropped on error or hang up. */
+void ipc_client_in(int fd, short mask, void *data) {
+    struct IpcClient *client = data;
+
+    if (mask & POLLOUT && ipc_client_flush(client) < 0) {
+        ipc_client_destroy(client);
+        return;
+    }
+
+    while (1) {
+        /* One byte is kept spare, see ipc_client_process. */
+        ssize_t bytes = read(fd, client->buffer + client->length, client->capacity - client->length - 1);
+        if (bytes < 0 && errno == EINTR)
+            continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (bytes <= 0) {
+            ipc_client_destroy(client);
+            return;
+        }
+
+        client->length += bytes;
+        if (ipc_client_process(client) < 0) {
+            ipc_client_destroy(client);
+            return;
+        }
+    }
+}
+
+int ipc_client_process(struct IpcClient *client) {
+    size_t offset = 0;
+    uint32_t length;
+
+    while (client->length - offset >= sizeof(length)) {
+        memcpy(&length, client->buffer + offset, sizeof(length));
+        if (length > IPC_MESSAGE_MAX) {
+            bar_log(LOG_ERROR, "ipc message of %u bytes is too long", length);
+            return -1;
+        }
+
+        if (client->length - offset - sizeof(length) < length) {
+            /* Make sure the rest of the message fits, framing and the spare byte included. */
+            if (sizeof(length) + length + 1 > client->capacity) {
+                client->capacity = sizeof(length) + length + 1;
+                if (!(client->buffer = realloc(client->buffer, client->capacity)))
+                    panic("realloc");
+            }
+            break;
+        }
+
+        char *message = client->buffer + offset + sizeof(length);
+        /* The message is handled as a string, the byte after it may belong to the next one. */
+        char next = message[length];
+        message[length] = '\0';
+        int result = ipc_message_handle(client, message, length);
+        message[length] = next;
+        if (result < 0)
+            return -1;
+
+        offset += sizeof(length) + length;
+    }
+
+    client->length -= offset;
+    if (offset > 0 && client->length > 0)
+        memmove(client->buffer, client->buffer + offset, client->length);
+
+    return 0;
+}
+
+/* Hands every line of the message to the listener, then sends back whatever was replied as one message. */
+int ipc_message_handle(struct IpcClient *client, char *message, size_t length) {
+    char *line = message, *newline, *end = message + length;
+
+    while (line < end) {
+        if ((newline = memchr(line, '\n', end - line)))
+            *newline = '\0';
+        if (*line)
+            client->server->listener->command(client, line);
+        line = newline ? newline + 1 : end;
+    }
+    client->server->listener->message_end(client);
+
+    if (client->reply_length == client->reply_start)
+        return 0;
+
+    uint32_t reply_length = client->reply_length - client->reply_start - sizeof(reply_length);
+    memcpy(client->reply + client->reply_start, &reply_length, sizeof(reply_length));
+    client->reply_start = client->reply_length;
+
+    return ipc_client_flush(client);
+}
+
+void ipc_reply(struct IpcClient *client, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    int length = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+    if (length < 0)
+        return;
+
+    /* The reply's length goes in front, once it is known. */
+    if (client->reply_length == client->reply_start)
+        client->reply_length += sizeof(uint32_t);
+    if (client->reply_length + length + 1 > client->reply_capacity) {
+        client->reply_capacity = (client->reply_length + length + 1) * 2;
+        if (!(client->reply = realloc(client->reply, client->reply_capacity)))
+            panic("realloc");
+    }
+
+    va_start(ap, fmt);
+    vsnprintf(client->reply + client->reply_length, length + 1, fmt, ap);
+    va_end(ap);
+    client->reply_length += length;
+}
+
+struct IpcServer *ipc_server_create(struct Events *events, const char *path, const struct IpcListener *listener) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        bar_log(LOG_ERROR, "ipc socket path is too long: %s", path);
+        return NULL;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        panic("socket");
+
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+        /* Left behind by a bar that didn't exit cleanly if nobody answers on it. */
+        int error = errno;
+        int probe = error == EADDRINUSE ? socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0) : -1;
+        int stale = probe >= 0
+            && connect(probe, (struct sockaddr*)&address, sizeof(address)) < 0 && errno == ECONNREFUSED;
+        if (probe >= 0)
+            close(probe);
+
+        if (!stale || unlink(path) < 0 || bind(fd, (struct sockaddr*)&address, sizeof(address)) < 0) {
+            bar_log(LOG_ERROR, "ipc socket %s: %s", path, strerror(error));
+            close(fd);
+            return NULL;
+        }
+    }
+
+    if (listen(fd, SOMAXCONN) < 0)
+        panic("listen");
+
+    struct IpcServer *server = ecalloc(1, sizeof(*server));
+    server->fd = fd;
+    server->path = strdup(path);
+    server->events = events;
+    server->listener = listener;
+    wl_list_init(&server->clients);
+    events_add(events, fd, POLLIN, server, ipc_accept);
+
+    return server;
+}
+
+void ipc_server_destroy(struct IpcServer *server) {
+    if (!server)
+        return;
+
+    struct IpcClient *client, *tmp;
+    wl_list_for_each_safe(client, tmp, &server->clients, link)
+        ipc_client_destroy(client);
+
+    events_remove(server->events, server->fd);
+    close(server->fd);
+    unlink(server->path);
+    free(server->path);
+    free(server);
+}
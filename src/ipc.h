@@ -0,0 +1,50 @@
+#ifndef IPC_H_
+#define IPC_H_
+
+#include "event.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <wayland-util.h>
+
+/*
+ * Messages on the socket are a uint32_t length in host byte order followed by that many bytes,
+ * holding one or more commands separated by newlines. Replies are framed the same way.
+ */
+#define IPC_MESSAGE_MAX 65536
+
+struct IpcClient;
+
+struct IpcListener {
+    void (*command)(struct IpcClient *client, const char *line);
+    void (*message_end)(struct IpcClient *client); /* Every command in a message has been handled */
+};
+
+struct IpcServer {
+    int fd;
+    char *path;
+    struct Events *events;
+    const struct IpcListener *listener;
+    struct wl_list clients; // struct IpcClient*
+};
+
+struct IpcClient {
+    int fd;
+    struct IpcServer *server;
+    char *buffer; /* Messages read so far, framing included */
+    size_t length, capacity;
+    /*
+     * Replies the socket didn't take yet, then the reply being built from reply_start on. That one starts with
+     * room for its length.
+     */
+    char *reply;
+    size_t reply_start, reply_length, reply_capacity;
+    int blocked; /* Waiting on POLLOUT to send the rest */
+
+    struct wl_list link;
+};
+
+void ipc_reply(struct IpcClient *client, const char *fmt, ...);
+struct IpcServer *ipc_server_create(struct Events *events, const char *path, const struct IpcListener *listener);
+void ipc_server_destroy(struct IpcServer *server);
+
+#endif // IPC_H_
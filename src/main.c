@@ -5,6 +5,11 @@
 #include "util.h"
 #include "main.h"
 #include "input.h"
+#include "ipc.h"
+#include "module.h"
+#include "parse.h"
+#include "reader.h"
+#include "record.h"
 #include "xdg-output-unstable-v1-protocol.h"
 #include "xdg-shell-protocol.h"
 #include "wlr-layer-shell-unstable-v1-protocol.h"
@@ -20,33 +25,62 @@
 #include <errno.h>
 #include <poll.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
 #include <wayland-client.h>
 #include <wayland-util.h>
 
+/* Power of two, there are rarely more monitors than buckets. */
+#define MONITOR_BUCKETS 16
+
 static void check_global(void *global, const char *name);
 static void check_globals(void);
 static void cleanup(void);
+static void commit_timeout(void *data);
+static void display_flush(void);
 static void display_in(int fd, short mask, void *data);
 static void fifo_handle(const char *line);
 static void fifo_in(int fd, short mask, void *data);
 static void fifo_setup(void);
+static void ipc_apply(struct IpcClient *client, struct Monitor *monitor, const struct ParsedLine *parsed);
+static void ipc_command(struct IpcClient *client, const char *line);
+static void ipc_message_end(struct IpcClient *client);
+static void ipc_setup(void);
+static void monitor_commit(struct Monitor *monitor);
 static void monitor_destroy(struct Monitor *monitor);
-static struct Monitor *monitor_from_name(const char *name);
+static struct Monitor *monitor_from_name(const char *name, size_t length);
 struct Monitor *monitor_from_surface(const struct wl_surface *surface);
 static void monitor_initialize(struct Monitor *monitor);
+static void monitor_name_set(struct Monitor *monitor, const char *name);
+static void monitor_name_unlink(struct Monitor *monitor);
+static void monitor_reply(struct IpcClient *client, struct Monitor *monitor);
+static void monitor_set_status(struct Monitor *monitor, const char *status);
+static void monitor_stage(struct Monitor *monitor, const struct ParsedLine *parsed);
 static void monitor_update(struct Monitor *monitor);
-static void pipe_in(int fd, short mask, void *data);
+static void monitors_commit(void);
+static void modules_publish(int index, const char *text);
+static void output_description(void *data, struct wl_output *output, const char *description);
+static void output_done(void *data, struct wl_output *output);
+static void output_geometry(void *data, struct wl_output *output, int32_t x, int32_t y, int32_t physical_width,
+                        int32_t physical_height, int32_t subpixel, const char *make, const char *model, int32_t transform);
+static void output_mode(void *data, struct wl_output *output, uint32_t flags, int32_t width, int32_t height, int32_t refresh);
+static void output_name(void *data, struct wl_output *output, const char *name);
+static void output_scale(void *data, struct wl_output *output, int32_t factor);
 static void registry_global_add(void *data, struct wl_registry *registry, uint32_t name,
                         const char *interface, uint32_t version);
 static void registry_global_remove(void *data, struct wl_registry *registry, uint32_t name);
 static void run(void);
-static void set_cloexec(int fd);
 static void setup(void);
 static void stdin_handle(const char *line);
 static void stdin_in(int fd, short mask, void *data);
-static void sigaction_handler(int _);
+static void signal_child(int signal, void *data);
+static void signal_stop(int signal, void *data);
+static void startup_log(const char *phase);
+static void state_text_set(char **text, size_t *capacity, const char *value);
+static void statuses_set(const char *status);
+static void statuses_show(const char *status);
+static void sync_done(void *data, struct wl_callback *callback, uint32_t callback_data);
 static void xdg_output_name(void *data, struct zxdg_output_v1 *output, const char *name);
 static void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t serial);
 
@@ -54,18 +88,57 @@ static struct xdg_wm_base *base;
 struct wl_compositor *compositor;
 static struct wl_display *display;
 static int display_fd;
+static int display_reading = 0; /* Between wl_display_prepare_read and read_events or cancel_read */
+static int display_blocked = 0; /* The socket was full, waiting on POLLOUT to flush the rest */
+/* Returns from events_poll, and how many of them read the display. Syscalls per wakeup take strace -c on top. */
+static unsigned long wakeups = 0, wakeups_reading = 0;
 static struct Events *events;
 static int fifo_fd;
+static struct LineReader *fifo_reader, *stdin_reader;
 static char *fifo_path;
+static struct IpcServer *ipc_server;
+static struct Modules *modules;
+/* The last status from the fifo or socket, shown ahead of the blocks on bars created later. */
+static char *status_external;
+static size_t status_external_capacity;
+static const struct IpcListener ipc_listener = {
+    .command = ipc_command,
+    .message_end = ipc_message_end,
+};
 static struct wl_list monitors; // struct Monitor*
+static struct Monitor *monitor_names[MONITOR_BUCKETS]; /* Named monitors by name hash, chained through name_next */
 static struct zxdg_output_manager_v1 *output_manager;
+/* Outputs from version 4 on name themselves, xdg-output is only needed for older ones. */
+static const struct wl_output_listener output_listener = {
+    .geometry = output_geometry,
+    .mode = output_mode,
+    .done = output_done,
+    .scale = output_scale,
+    .name = output_name,
+    .description = output_description,
+};
 static const struct wl_registry_listener registry_listener = {
     .global = registry_global_add,
     .global_remove = registry_global_remove,
 };
 static int running = 0;
+/*
+ * The last status line taken from the fifo, a repeat of it is dropped before any monitor sees it.
+ * The hash rules out most changes cheaply, the bytes are still compared so a collision isn't taken for a repeat.
+ */
+static char *status_last;
+static size_t status_last_capacity;
+static uint32_t status_hash;
+static size_t status_length = -1;
+static unsigned long updates_suppressed = 0; /* Status lines and commits that changed nothing */
+static uint64_t burst_started = 0; /* When the first line not yet committed came in, 0 if there is none */
+static struct EventTimer *commit_timer; /* Commits a burst commit_deadline after it started */
+static int single_threaded = 0; /* -s, ignore render_threads */
+static uint64_t startup_began, startup_phase; /* See startup_log, startup_phase is 0 once the first frame is out */
+static const struct wl_callback_listener sync_listener = {
+    .done = sync_done,
+};
 static struct wl_list seats; // struct Seat*
-static int self_pipe[2];
 struct zwlr_layer_shell_v1 *shell;
 struct wl_shm *shm;
 static const struct zxdg_output_v1_listener xdg_output_listener = {
@@ -84,27 +157,45 @@ void check_global(void *global, const char *name) {
 void check_globals(void) {
     check_global(base, "xdg_wm_base");
     check_global(compositor, "wl_compositor");
-    check_global(output_manager, "zxdg_output_manager_v1");
+    if (!output_manager) {
+        struct Monitor *monitor;
+        wl_list_for_each(monitor, &monitors, link)
+            if (wl_output_get_version(monitor->wl_output) < WL_OUTPUT_NAME_SINCE_VERSION)
+                check_global(output_manager, "zxdg_output_manager_v1");
+    }
     check_global(shell, "zwlr_layer_shell_v1");
     check_global(shm, "wl_shm");
 }
 
 void cleanup(void) {
+    bar_log(LOG_INFO, "Updates: %lu suppressed", updates_suppressed);
+    bar_log(LOG_INFO, "Wakeups: %lu, %lu of them read the display", wakeups, wakeups_reading);
+
+    struct Monitor *monitor, *tmp_monitor;
+    wl_list_for_each_safe(monitor, tmp_monitor, &monitors, link)
+        monitor_destroy(monitor);
+    pipeline_workers_stop();
+    font_preload_stop();
+
     xdg_wm_base_destroy(base);
     wl_compositor_destroy(compositor);
+    line_reader_destroy(fifo_reader);
+    line_reader_destroy(stdin_reader);
     close(fifo_fd);
     unlink(fifo_path);
     free(fifo_path);
+    ipc_server_destroy(ipc_server);
+    modules_destroy(modules);
+    free(status_external);
+    free(status_last);
     zxdg_output_manager_v1_destroy(output_manager);
     zwlr_layer_shell_v1_destroy(shell);
     wl_shm_destroy(shm);
+    events_timer_remove(events, commit_timer);
     events_destroy(events);
+    record_stop();
     log_destroy();
 
-    struct Monitor *monitor, *tmp_monitor;
-    wl_list_for_each_safe(monitor, tmp_monitor, &monitors, link)
-        monitor_destroy(monitor);
-
     struct Seat *seat, *tmp_seat;
     wl_list_for_each_safe(seat, tmp_seat, &seats, link)
         seat_destroy(seat);
@@ -112,60 +203,70 @@ void cleanup(void) {
     wl_display_disconnect(display);
 }
 
-void display_in(int fd, short mask, void *data) {
-    if (mask & (POLLHUP | POLLERR) ||
-            wl_display_dispatch(display) == -1) {
+void commit_timeout(void *data) {
+    monitors_commit();
+}
+
+/* Sends what's queued for the compositor. A full socket is left to POLLOUT rather than flushed again every wakeup. */
+void display_flush(void) {
+    if (wl_display_flush(display) != -1) {
+        if (display_blocked) {
+            display_blocked = 0;
+            events_modify(events, display_fd, POLLIN);
+        }
+        return;
+    }
+
+    if (errno != EAGAIN) {
         running = 0;
         return;
     }
+    if (!display_blocked) {
+        display_blocked = 1;
+        events_modify(events, display_fd, POLLIN | POLLOUT);
+    }
 }
 
-void fifo_handle(const char *line) {
-    char *command;
-    unsigned long loc = 0;
-
-    command = to_delimiter(line, &loc, ' ');
-
-    if (STRING_EQUAL(command, "status")) {
-        char *status = to_delimiter(line, &loc, '\n');
-        struct Monitor *pos;
-        wl_list_for_each(pos, &monitors, link) {
-            bar_set_status(pos->bar, status);
-            pipeline_invalidate(pos->pipeline);
+/* The events read here are dispatched by run once everything else that woke up has been handled. */
+void display_in(int fd, short mask, void *data) {
+    if (mask & POLLOUT)
+        display_flush();
+
+    if (mask & POLLIN && display_reading) {
+        display_reading = 0;
+        wakeups_reading++;
+        if (wl_display_read_events(display) == -1) {
+            running = 0;
+            return;
         }
-        free(status);
     }
 
-    free(command);
+    if (mask & (POLLHUP | POLLERR))
+        running = 0;
+}
+
+void fifo_handle(const char *line) {
+    struct ParsedLine parsed;
+    if (parse_fifo_line(line, &parsed) < 0)
+        return;
+
+    statuses_set(parsed.text);
 }
 
 void fifo_in(int fd, short mask, void *data) {
     if (mask & POLLERR) {
         events_remove(events, fd);
         char *default_status = string_create("dwl %.1f", VERSION);
+        status_length = -1;
         struct Monitor *pos;
-        wl_list_for_each(pos, &monitors, link) {
-            bar_set_status(pos->bar, default_status);
-            pipeline_invalidate(pos->pipeline);
-        }
+        wl_list_for_each(pos, &monitors, link)
+            monitor_set_status(pos, default_status);
         free(default_status);
         return;
     }
 
-    int new_fd = dup(fd);
-    FILE *fifo_file = fdopen(new_fd, "r");
-    char *buffer = NULL;
-    size_t size = 0;
-    while (1) {
-        if (getline(&buffer, &size, fifo_file) == -1)
-            break;
-
-        fifo_handle(buffer);
-    }
-    free(buffer);
-    fclose(fifo_file);
-    close(new_fd);
-
+    /* The fifo is open for writing too, so it never reaches end of file. */
+    line_reader_read(fifo_reader, fifo_handle);
 }
 
 void fifo_setup(void) {
@@ -192,48 +293,257 @@ void fifo_setup(void) {
   panic("setup fifo"); /* If we get here then we couldn't setup the fifo */
 }
 
+void ipc_apply(struct IpcClient *client, struct Monitor *monitor, const struct ParsedLine *parsed) {
+    switch (parsed->command) {
+        case Command_Get:
+            monitor_reply(client, monitor);
+            break;
+        case Command_Status:
+            monitor_set_status(monitor, parsed->text);
+            /* The other monitors still show the last status, let it through again. */
+            status_length = -1;
+            break;
+        default:
+            /* Committed along with the rest of the message, see ipc_message_end. */
+            monitor_stage(monitor, parsed);
+            break;
+    }
+}
+
+/* "<monitor|all> <command> <arguments>", where commands are those of dwl plus status and get. */
+void ipc_command(struct IpcClient *client, const char *line) {
+    struct ParsedLine parsed;
+    if (parse_ipc_line(line, &parsed) < 0) {
+        ipc_reply(client, "error unknown command: %s\n", line);
+        return;
+    }
+
+    if (!(parsed.monitor.length == 3 && memcmp(parsed.monitor.start, "all", 3) == 0)) {
+        struct Monitor *monitor = monitor_from_name(parsed.monitor.start, parsed.monitor.length);
+        if (monitor)
+            ipc_apply(client, monitor, &parsed);
+        else
+            ipc_reply(client, "error unknown monitor: %.*s\n", (int)parsed.monitor.length, parsed.monitor.start);
+        return;
+    }
+
+    if (parsed.command == Command_Status) {
+        statuses_set(parsed.text);
+        return;
+    }
+
+    struct Monitor *pos;
+    wl_list_for_each(pos, &monitors, link) {
+        if (pos->xdg_name)
+            ipc_apply(client, pos, &parsed);
+    }
+}
+
+void ipc_message_end(struct IpcClient *client) {
+    monitors_commit();
+}
+
+void ipc_setup(void) {
+    char *runtime_path = getenv("XDG_RUNTIME_DIR"), *wayland_display = getenv("WAYLAND_DISPLAY");
+
+    /* One bar per compositor, so clients can find it without probing. */
+    char *path = string_create("%s/dwl-bar-%s.sock", runtime_path, wayland_display ? wayland_display : "wayland-0");
+    if (!(ipc_server = ipc_server_create(events, path, &ipc_listener)))
+        bar_log(LOG_ERROR, "Continuing without the ipc socket");
+    free(path);
+}
+
+/* Applies to the bar only the fields dwl actually changed since the last commit, not every line it wrote. */
+void monitor_commit(struct Monitor *monitor) {
+    struct MonitorState *staged = &monitor->staged, *shown = &monitor->shown;
+    unsigned int fields = monitor->staged_fields;
+    int changed = 0;
+
+    /* Kept until there is a bar to show them on, a bar that isn't shown yet is shown even with nothing staged. */
+    if (!monitor->bar || (!fields && pipeline_is_visible(monitor->pipeline)))
+        return;
+    monitor->staged_fields = 0;
+
+    if (fields & Field_Title && (!shown->title || !STRING_EQUAL(staged->title, shown->title))) {
+        state_text_set(&shown->title, &shown->title_capacity, staged->title);
+        changed |= bar_set_title(monitor->bar, shown->title);
+    }
+    if (fields & Field_Layout && (!shown->layout || !STRING_EQUAL(staged->layout, shown->layout))) {
+        state_text_set(&shown->layout, &shown->layout_capacity, staged->layout);
+        changed |= bar_set_layout(monitor->bar, shown->layout);
+    }
+    if (fields & Field_Tags && (staged->occupied != shown->occupied || staged->tags != shown->tags
+                || staged->clients != shown->clients || staged->urgent != shown->urgent)) {
+        shown->occupied = staged->occupied;
+        shown->tags = staged->tags;
+        shown->clients = staged->clients;
+        shown->urgent = staged->urgent;
+
+        for (int i = 0; i < LENGTH(tags); i++) {
+            int state = Tag_None;
+            uint32_t tag_mask = 1 << i;
+
+            if (shown->tags & tag_mask)
+                state |= Tag_Active;
+            if (shown->urgent & tag_mask)
+                state |= Tag_Urgent;
+
+            changed |= bar_set_tag(monitor->bar, i, state, shown->occupied & tag_mask ? 1 : 0, shown->clients & tag_mask ? 1 : 0);
+        }
+    }
+    if (fields & Field_Floating && staged->floating != shown->floating) {
+        shown->floating = staged->floating;
+        changed |= bar_set_floating(monitor->bar, shown->floating);
+    }
+    if (fields & Field_Selmon && staged->selmon != shown->selmon) {
+        shown->selmon = staged->selmon;
+        changed |= bar_set_active(monitor->bar, shown->selmon);
+    }
+
+    /* A bar that isn't shown yet still has to be, whether or not anything changed. */
+    if (!changed && pipeline_is_visible(monitor->pipeline)) {
+        updates_suppressed++;
+        return;
+    }
+    monitor_update(monitor);
+}
+
 void monitor_destroy(struct Monitor *monitor) {
     if (!monitor)
         return;
 
+    monitor_name_unlink(monitor);
     free(monitor->xdg_name);
+    if (monitor->xdg_output)
+        zxdg_output_v1_destroy(monitor->xdg_output);
+    free(monitor->staged.title);
+    free(monitor->staged.layout);
+    free(monitor->shown.title);
+    free(monitor->shown.layout);
+    free(monitor->shown.status);
     if (wl_output_get_version(monitor->wl_output) >= WL_OUTPUT_RELEASE_SINCE_VERSION)
         wl_output_release(monitor->wl_output);
     list_elements_destroy(monitor->hotspots, free);
-    pipeline_destroy(monitor->pipeline);
     bar_destroy(monitor->bar);
+    pipeline_destroy(monitor->pipeline);
     free(monitor);
 }
 
-struct Monitor *monitor_from_name(const char *name) {
-    struct Monitor *pos;
-    wl_list_for_each(pos, &monitors, link) {
-        if (STRING_EQUAL(name, pos->xdg_name))
+struct Monitor *monitor_from_name(const char *name, size_t length) {
+    uint32_t hash = string_hash(name, length);
+
+    for (struct Monitor *pos = monitor_names[hash & (MONITOR_BUCKETS - 1)]; pos; pos = pos->name_next) {
+        if (pos->name_hash == hash && pos->name_length == length && memcmp(name, pos->xdg_name, length) == 0)
             return pos;
     }
 
     return NULL;
 }
 
+/* The surface carries its monitor as user data, see monitor_update. */
 struct Monitor *monitor_from_surface(const struct wl_surface *surface) {
-    struct Monitor *pos;
-    wl_list_for_each(pos, &monitors, link) {
-        if (pos->pipeline->surface == surface)
-            return pos;
-    }
+    if (!surface)
+        return NULL;
 
-    return NULL;
+    return wl_surface_get_user_data((struct wl_surface*)surface);
 }
 
 void monitor_initialize(struct Monitor *monitor) {
     if (!monitor) return;
 
     monitor->hotspots = list_create(1);
-    monitor->pipeline = pipeline_create();
+    monitor->pipeline = pipeline_create(events);
     monitor->bar = bar_create(monitor->hotspots, monitor->pipeline);
     if (!monitor->pipeline || !monitor->bar)
         panic("Failed to create a pipline or bar for monitor: %s", monitor->xdg_name);
-    monitor_update(monitor);
+    /* The new bar only has the default status, let the next status line through even if it is a repeat. */
+    status_length = -1;
+    if (modules) {
+        monitor_set_status(monitor, status_external ? status_external : "");
+        for (int i = 0; i < modules->length; i++)
+            bar_set_block(monitor->bar, i, modules->modules[i].text);
+    }
+    /* Anything dwl said before the bar existed, committing also shows the bar. */
+    monitor_commit(monitor);
+}
+
+/* Names the monitor and files it under the name's hash so stdin lines find it with one compare. */
+void monitor_name_set(struct Monitor *monitor, const char *name) {
+    monitor_name_unlink(monitor);
+    free(monitor->xdg_name);
+
+    monitor->xdg_name = strdup(name);
+    monitor->name_length = strlen(name);
+    monitor->name_hash = string_hash(name, monitor->name_length);
+
+    struct Monitor **bucket = &monitor_names[monitor->name_hash & (MONITOR_BUCKETS - 1)];
+    monitor->name_next = *bucket;
+    *bucket = monitor;
+}
+
+void monitor_name_unlink(struct Monitor *monitor) {
+    if (!monitor->xdg_name)
+        return;
+
+    struct Monitor **slot = &monitor_names[monitor->name_hash & (MONITOR_BUCKETS - 1)];
+    while (*slot && *slot != monitor)
+        slot = &(*slot)->name_next;
+    if (*slot)
+        *slot = monitor->name_next;
+    monitor->name_next = NULL;
+}
+
+/* The monitor's state in the same format dwl writes it. */
+void monitor_reply(struct IpcClient *client, struct Monitor *monitor) {
+    const struct MonitorState *shown = &monitor->shown;
+    const char *name = monitor->xdg_name;
+
+    ipc_reply(client, "%s title %s\n%s layout %s\n%s tags %u %u %u %u\n%s floating %u\n%s selmon %u\n%s status %s\n",
+            name, shown->title ? shown->title : "",
+            name, shown->layout ? shown->layout : "",
+            name, shown->occupied, shown->tags, shown->clients, shown->urgent,
+            name, shown->floating,
+            name, shown->selmon,
+            name, shown->status ? shown->status : "");
+}
+
+void monitor_set_status(struct Monitor *monitor, const char *status) {
+    state_text_set(&monitor->shown.status, &monitor->shown.status_capacity, status);
+    if (bar_set_status(monitor->bar, status))
+        pipeline_invalidate(monitor->pipeline);
+}
+
+void monitor_stage(struct Monitor *monitor, const struct ParsedLine *parsed) {
+    struct MonitorState *staged = &monitor->staged;
+
+    switch (parsed->command) {
+        case Command_Title:
+            state_text_set(&staged->title, &staged->title_capacity, parsed->text);
+            monitor->staged_fields |= Field_Title;
+            break;
+        case Command_Layout:
+            state_text_set(&staged->layout, &staged->layout_capacity, parsed->text);
+            monitor->staged_fields |= Field_Layout;
+            break;
+        case Command_Tags:
+            staged->occupied = parsed->occupied;
+            staged->tags = parsed->tags;
+            staged->clients = parsed->clients;
+            staged->urgent = parsed->urgent;
+            monitor->staged_fields |= Field_Tags;
+            break;
+        case Command_Floating:
+            staged->floating = parsed->value == 1;
+            monitor->staged_fields |= Field_Floating;
+            break;
+        case Command_Selmon:
+            staged->selmon = parsed->value == 1;
+            monitor->staged_fields |= Field_Selmon;
+            break;
+        default:
+            /* appid and fullscreen aren't shown */
+            break;
+    }
 }
 
 void monitor_update(struct Monitor *monitor) {
@@ -242,12 +552,24 @@ void monitor_update(struct Monitor *monitor) {
 
     if (!pipeline_is_visible(monitor->pipeline)) {
         pipeline_show(monitor->pipeline, monitor->wl_output);
+        if (monitor->pipeline->surface)
+            wl_surface_set_user_data(monitor->pipeline->surface, monitor);
         return;
     }
 
     pipeline_invalidate(monitor->pipeline);
 }
 
+void monitors_commit(void) {
+    if (burst_started)
+        events_timer_set(commit_timer, 0, 0);
+    burst_started = 0;
+
+    struct Monitor *monitor;
+    wl_list_for_each(monitor, &monitors, link)
+        monitor_commit(monitor);
+}
+
 void monitors_update(void) {
     struct Monitor *monitor;
     wl_list_for_each(monitor, &monitors, link) {
@@ -255,35 +577,58 @@ void monitors_update(void) {
     }
 }
 
-void pipe_in(int fd, short mask, void *data) {
-    running = 0;
+/* A status block's text changed, it goes straight to that block's slot in every bar. */
+void modules_publish(int index, const char *text) {
+    struct Monitor *monitor;
+    wl_list_for_each(monitor, &monitors, link)
+        if (bar_set_block(monitor->bar, index, text))
+            pipeline_invalidate(monitor->pipeline);
 }
 
+void output_description(void *data, struct wl_output *output, const char *description) {}
+
+void output_done(void *data, struct wl_output *output) {}
+
+void output_geometry(void *data, struct wl_output *output, int32_t x, int32_t y, int32_t physical_width,
+                        int32_t physical_height, int32_t subpixel, const char *make, const char *model, int32_t transform) {}
+
+void output_mode(void *data, struct wl_output *output, uint32_t flags, int32_t width, int32_t height, int32_t refresh) {}
+
+void output_name(void *data, struct wl_output *output, const char *name) {
+    monitor_name_set(data, name);
+}
+
+void output_scale(void *data, struct wl_output *output, int32_t factor) {}
+
 void registry_global_add(void *data, struct wl_registry *registry, uint32_t name,
                         const char *interface, uint32_t version) {
     if (STRING_EQUAL(interface, wl_compositor_interface.name))
         compositor = wl_registry_bind(registry, name, &wl_compositor_interface, 4);
     else if (STRING_EQUAL(interface, wl_output_interface.name)) {
         struct Monitor *monitor = ecalloc(1, sizeof(*monitor));
-        monitor->wl_output = wl_registry_bind(registry, name, &wl_output_interface, 1);
+        monitor->wl_output = wl_registry_bind(registry, name, &wl_output_interface,
+                version < WL_OUTPUT_NAME_SINCE_VERSION ? version : WL_OUTPUT_NAME_SINCE_VERSION);
         monitor->wl_name = name;
         monitor->xdg_name = NULL;
         monitor->xdg_output = NULL;
 
         wl_list_insert(&monitors, &monitor->link);
 
-        if (!output_manager)
-            return;
-
-        monitor->xdg_output = zxdg_output_manager_v1_get_xdg_output(output_manager, monitor->wl_output);
-        zxdg_output_v1_add_listener(monitor->xdg_output, &xdg_output_listener, monitor);
+        if (version >= WL_OUTPUT_NAME_SINCE_VERSION) {
+            wl_output_add_listener(monitor->wl_output, &output_listener, monitor);
+        } else if (output_manager) {
+            monitor->xdg_output = zxdg_output_manager_v1_get_xdg_output(output_manager, monitor->wl_output);
+            zxdg_output_v1_add_listener(monitor->xdg_output, &xdg_output_listener, monitor);
+        } else if (running) {
+            bar_log(LOG_ERROR, "Output %u can't be named without zxdg_output_manager_v1", name);
+        }
 
         if (!running) return;
         monitor_initialize(monitor);
     }
     else if (STRING_EQUAL(interface, wl_seat_interface.name)) {
         struct Seat *seat = ecalloc(1, sizeof(*seat));
-        seat->seat = wl_registry_bind(registry, name, &wl_seat_interface, 5);
+        seat->seat = wl_registry_bind(registry, name, &wl_seat_interface, version < SEAT_VERSION ? version : SEAT_VERSION);
         seat->wl_name = name;
         seat->pointer = NULL;
         seat->touch = NULL;
@@ -302,7 +647,8 @@ void registry_global_add(void *data, struct wl_registry *registry, uint32_t name
         struct Monitor *pos;
         wl_list_for_each(pos, &monitors, link) {
             // If the monitor is getting or has the xdg_name.
-            if (pos->xdg_output || pos->xdg_name)
+            if (pos->xdg_output || pos->xdg_name ||
+                    wl_output_get_version(pos->wl_output) >= WL_OUTPUT_NAME_SINCE_VERSION)
                 continue;
 
             pos->xdg_output = zxdg_output_manager_v1_get_xdg_output(output_manager, pos->wl_output);
@@ -332,47 +678,59 @@ void registry_global_remove(void *data, struct wl_registry *registry, uint32_t n
 void run(void) {
     running = 1;
 
+    /*
+     * The display is only read by display_in, after the one poll in events_poll said it's readable,
+     * wl_display_dispatch would poll it a second time. Nothing here may roundtrip while a read is prepared.
+     */
     while (running) {
-        wl_display_dispatch_pending(display);
-        if (wl_display_flush(display) == -1 && errno != EAGAIN)
-            break;
+        while (wl_display_prepare_read(display) == -1)
+            if (wl_display_dispatch_pending(display) == -1)
+                return;
+        display_reading = 1;
+
+        pipeline_render_ready();
+        if (startup_phase) {
+            struct Monitor *monitor;
+            wl_list_for_each(monitor, &monitors, link) {
+                if (monitor->pipeline && monitor->pipeline->frames_rendered) {
+                    startup_log("first frame");
+                    startup_phase = 0;
+                    break;
+                }
+            }
+        }
+        if (!display_blocked)
+            display_flush();
 
         events_poll(events);
-    }
-}
+        wakeups++;
 
-void set_cloexec(int fd) {
-    int flags = fcntl(fd, F_GETFD);
-    if (flags == -1)
-        panic("F_GETFD");
-    if (fcntl(fd, F_SETFD, flags | FD_CLOEXEC) < 0)
-        panic("FD_SETFD");
+        if (display_reading) {
+            display_reading = 0;
+            wl_display_cancel_read(display);
+        }
+        if (wl_display_dispatch_pending(display) == -1)
+            break;
+    }
 }
 
 void setup(void) {
-    if (pipe(self_pipe) == -1)
-        panic("pipe");
-
-    set_cloexec(self_pipe[0]);
-    set_cloexec(self_pipe[1]);
-
-    static struct sigaction sighandle;
-    static struct sigaction child_sigaction;
-
-    sighandle.sa_handler = &sigaction_handler;
-    child_sigaction.sa_handler = SIG_IGN;
+    /* Signals are blocked and read from the loop, before any render thread exists to inherit the old mask. */
+    events = events_create();
+    events_signal_add(events, SIGTERM, NULL, signal_stop);
+    events_signal_add(events, SIGINT, NULL, signal_stop);
+    events_signal_add(events, SIGCHLD, NULL, signal_child);
 
-    if (sigaction(SIGTERM, &sighandle, NULL) < 0)
-        panic("sigaction SIGTERM");
-    if (sigaction(SIGINT, &sighandle, NULL) < 0)
-        panic("sigaction SIGINT");
-    if (sigaction(SIGCHLD, &child_sigaction, NULL) < 0)
-        panic("sigaction SIGCHLD");
+    /* Fontconfig is the slowest part of starting, it runs alongside everything up to the first bar. */
+    commit_timer = events_timer_add(events, NULL, commit_timeout);
+    startup_began = startup_phase = time_us();
+    font_preload(font);
 
     display = wl_display_connect(NULL);
     if (!display)
         panic("Failed to connect to Wayland compositor.");
     display_fd = wl_display_get_fd(display);
+    startup_log("connected");
 
     wl_list_init(&seats);
     wl_list_init(&monitors);
@@ -380,140 +738,146 @@ void setup(void) {
     struct wl_registry *registry = wl_display_get_registry(display);
     wl_registry_add_listener(registry, &registry_listener, NULL);
     wl_display_roundtrip(display);
+    check_globals();
+    startup_log("globals");
+
+    /* Output names come in answer to the binds, set up everything local while the compositor gets to them. */
+    int synced = 0;
+    struct wl_callback *sync = wl_display_sync(display);
+    wl_callback_add_listener(sync, &sync_listener, &synced);
+    wl_display_flush(display);
 
     fifo_setup();
+    ipc_setup();
 
-    check_globals();
+    if (!single_threaded)
+        pipeline_workers_start(render_threads);
 
-    wl_display_roundtrip(display);
+    while (!synced)
+        if (wl_display_dispatch(display) == -1)
+            panic("Lost the Wayland compositor while naming outputs");
+    startup_log("outputs named");
 
     struct Monitor *monitor;
     wl_list_for_each(monitor, &monitors, link) {
         monitor_initialize(monitor);
     }
+    startup_log("bars created");
 
     if (fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK) < 0)
         panic("STDIN_FILENO O_NONBLOCK");
+    stdin_reader = line_reader_create(STDIN_FILENO, max_line_length);
+    fifo_reader = line_reader_create(fifo_fd, max_line_length);
 
-    events = events_create();
     events_add(events, display_fd, POLLIN, NULL, display_in);
-    events_add(events, self_pipe[0], POLLIN, NULL, pipe_in);
     events_add(events, STDIN_FILENO, POLLIN, NULL, stdin_in);
     events_add(events, fifo_fd, POLLIN, NULL, fifo_in);
+
+    if (status_modules)
+        modules = modules_create(events, status_blocks, LENGTH(status_blocks), modules_publish);
 }
 
 void stdin_handle(const char *line) {
     if (!line)
         return;
 
-    char *name, *command;
+    struct ParsedLine parsed;
     struct Monitor *monitor;
-    unsigned long loc = 0; /* Keep track of where we are in the string `line` */
-
-    name = to_delimiter(line, &loc, ' ');
-    command = to_delimiter(line, &loc, ' ');
-    monitor = monitor_from_name(name);
-    if (!monitor) {
-        free(name);
-        free(command);
+
+    if (parse_dwl_line(line, &parsed) < 0)
+        return;
+    if (!(monitor = monitor_from_name(parsed.monitor.start, parsed.monitor.length)))
         return;
+
+    monitor_stage(monitor, &parsed);
+
+    /*
+     * Lines are held until commit_deadline after the first of a burst, so everything dwl writes for one event
+     * reaches the bar at once. The timer can't fire during a long read, that is checked here.
+     */
+    uint64_t now = time_ms();
+    if (!burst_started) {
+        burst_started = now;
+        events_timer_set(commit_timer, commit_deadline ? commit_deadline : 1, 0);
+    } else if (now - burst_started >= commit_deadline) {
+        monitors_commit();
     }
-    free(name);
-
-    if (STRING_EQUAL(command, "title")) {
-        char *title = to_delimiter(line, &loc, '\n');
-        if (*title == '\0') {
-            bar_set_title(monitor->bar, "");
-        } else
-            bar_set_title(monitor->bar, title);
-        free(title);
-    } else if (STRING_EQUAL(command, "appid")) {
-        /* Do nothing */
-    } else if (STRING_EQUAL(command, "floating")) {
-        char *is_floating = to_delimiter(line, &loc, '\n');
-        if (*is_floating == '1')
-            bar_set_floating(monitor->bar, 1);
-        else
-            bar_set_floating(monitor->bar, 0);
-        free(is_floating);
-    } else if (STRING_EQUAL(command, "fullscreen")) {
-        /* Do nothing */
-    } else if (STRING_EQUAL(command, "selmon")) {
-        char *selmon = to_delimiter(line, &loc, '\n');
-        if (*selmon == '1')
-            bar_set_active(monitor->bar, 1);
-        else
-            bar_set_active(monitor->bar, 0);
-        free(selmon);
-    } else if (STRING_EQUAL(command, "tags")) {
-        char *occupied_str, *tags_str, *clients_str, *urgent_str;
-        int occupied, _tags, clients, urgent, i, tag_mask, state;
-
-        occupied_str = to_delimiter(line, &loc, ' ');
-        tags_str    = to_delimiter(line, &loc, ' ');
-        clients_str = to_delimiter(line, &loc, ' ');
-        urgent_str  = to_delimiter(line, &loc, ' ');
-
-        occupied = atoi(occupied_str);
-        _tags    = atoi(tags_str);
-        clients  = atoi(clients_str);
-        urgent   = atoi(urgent_str);
-
-        for (i = 0; i < LENGTH(tags); i++) {
-            state    = Tag_None;
-            tag_mask = 1 << i;
-
-            if (_tags & tag_mask)
-                state |= Tag_Active;
-            if (urgent & tag_mask)
-                state |= Tag_Urgent;
+}
 
-            bar_set_tag(monitor->bar, i, state, occupied & tag_mask ? 1 : 0, clients & tag_mask ? 1 : 0);
-        }
+void stdin_in(int fd, short mask, void *data) {
+    /* A read can end partway through dwl's lines for a monitor, they are committed by commit_timer. */
+    int result = line_reader_read(stdin_reader, stdin_handle);
 
-        free(occupied_str);
-        free(tags_str);
-        free(clients_str);
-        free(urgent_str);
-    } else if (STRING_EQUAL(command, "layout")) {
-        char *layout = to_delimiter(line, &loc, '\n');
-        bar_set_layout(monitor->bar, layout);
-        free(layout);
+    /* Whatever dwl wrote before going away is still handled. A regular file would otherwise be polled forever. */
+    if (result < 0 || mask & (POLLHUP | POLLERR)) {
+        events_remove(events, fd);
+        monitors_commit();
+        running = 0;
     }
+}
 
-    free(command);
-    monitor_update(monitor);
+/* Reaps every spawned child that has exited, one signal can stand for several. */
+void signal_child(int signal, void *data) {
+    while (waitpid(-1, NULL, WNOHANG) > 0);
 }
 
-void stdin_in(int fd, short mask, void *data) {
-    if (mask & (POLLHUP | POLLERR)) {
-        running = 0;
-        return;
+void signal_stop(int signal, void *data) {
+    running = 0;
+}
+
+/* Logs how long a phase of starting up took, the total is since setup began. */
+void startup_log(const char *phase) {
+    uint64_t now = time_us();
+    bar_log(LOG_INFO, "Startup: %s after %.1f ms, %.1f ms in", phase,
+            (now - startup_phase) / 1000.0, (now - startup_began) / 1000.0);
+    startup_phase = now;
+}
+
+/* Copies value into text, which only grows. */
+void state_text_set(char **text, size_t *capacity, const char *value) {
+    size_t length = strlen(value);
+
+    if (length + 1 > *capacity) {
+        *capacity = length + 1;
+        if (!(*text = realloc(*text, *capacity)))
+            panic("realloc");
     }
+    memcpy(*text, value, length + 1);
+}
 
-    int new_fd = dup(fd);
-    FILE *stdin_file = fdopen(new_fd, "r");
-    char *buffer = NULL;
-    size_t size = 0;
-    while(1) {
-         if (getline(&buffer, &size, stdin_file) == -1)
-            break;
+/* A new status from the fifo or socket for every monitor. */
+void statuses_set(const char *status) {
+    if (modules)
+        state_text_set(&status_external, &status_external_capacity, status);
 
-        stdin_handle(buffer);
+    statuses_show(status);
+}
+
+/* Sets the status of every monitor, a status just like the last one changes nothing. */
+void statuses_show(const char *status) {
+    size_t length = strlen(status);
+    uint32_t hash = string_hash(status, length);
+    if (length == status_length && hash == status_hash && memcmp(status, status_last, length) == 0) {
+        updates_suppressed++;
+        return;
     }
-    free(buffer);
-    fclose(stdin_file);
-    close(new_fd);
+    status_length = length;
+    status_hash = hash;
+    state_text_set(&status_last, &status_last_capacity, status);
+
+    struct Monitor *pos;
+    wl_list_for_each(pos, &monitors, link)
+        monitor_set_status(pos, status);
 }
 
-void sigaction_handler(int _) {
-    if (write(self_pipe[1], "0", 1) < 0)
-        panic("sigaction_handler");
+void sync_done(void *data, struct wl_callback *callback, uint32_t callback_data) {
+    *(int*)data = 1;
+    wl_callback_destroy(callback);
 }
 
 void xdg_output_name(void *data, struct zxdg_output_v1 *output, const char *name) {
     struct Monitor *monitor = data;
-    monitor->xdg_name = strdup(name);
+    monitor_name_set(monitor, name);
     zxdg_output_v1_destroy(output);
     monitor->xdg_output = NULL;
 }
@@ -524,21 +888,28 @@ void xdg_wm_base_ping(void *data, struct xdg_wm_base *xdg_wm_base, uint32_t seri
 
 int main(int argc, char *argv[]) {
     int opt;
-    while((opt = getopt(argc, argv, "hlv")) != -1) {
+    while((opt = getopt(argc, argv, "hlr:sv")) != -1) {
         switch (opt) {
             case 'l':
                 if (!setup_log())
                     panic("Failed to setup logging");
                 break;
+            case 'r':
+                if (!record_start(optarg))
+                    panic("Failed to start recording input to %s:", optarg);
+                break;
+            case 's':
+                single_threaded = 1;
+                break;
             case 'h':
-                printf("Usage: %s [-h] [-v]\n", argv[0]);
+                printf("Usage: %s [-h] [-v] [-l] [-s] [-r file]\n", argv[0]);
                 exit(EXIT_SUCCESS);
             case 'v':
                 printf("%s %.1f\n", argv[0], VERSION);
                 exit(EXIT_SUCCESS);
             case '?':
                 printf("Invalid Argument\n");
-                printf("Usage: %s [-h] [-v] [-l]\n", argv[0]);
+                printf("Usage: %s [-h] [-v] [-l] [-s] [-r file]\n", argv[0]);
                 exit(EXIT_FAILURE);
         }
     }
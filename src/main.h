@@ -8,9 +8,29 @@
 
 #define VERSION 0.0
 
+/* What dwl reports about a monitor that the bar shows, see monitor_commit. */
+enum MonitorField {
+    Field_Title    = 1 << 0,
+    Field_Layout   = 1 << 1,
+    Field_Tags     = 1 << 2,
+    Field_Floating = 1 << 3,
+    Field_Selmon   = 1 << 4,
+};
+
+struct MonitorState {
+    char *title, *layout, *status /* Only ever shown, it doesn't come from dwl */;
+    size_t title_capacity, layout_capacity, status_capacity;
+    uint32_t occupied, tags, clients, urgent;
+    unsigned int floating, selmon;
+};
+
 struct Monitor {
     char *xdg_name;
     uint32_t wl_name;
+    /* Index by xdg_name, see monitor_name_set */
+    uint32_t name_hash;
+    size_t name_length;
+    struct Monitor *name_next; /* Next monitor in the same bucket */
 
     struct wl_output *wl_output;
     struct zxdg_output_v1 *xdg_output;
@@ -18,6 +38,10 @@ struct Monitor {
     struct List *hotspots; /* struct Hotspot* */
     struct Bar *bar;
 
+    /* Lines from dwl land in staged, which is compared against shown once dwl is done writing. */
+    struct MonitorState staged, shown;
+    unsigned int staged_fields; /* enum MonitorField's set since the last commit */
+
     struct wl_list link;
 };
 
@@ -0,0 +1,223 @@
+#include "module.h"
+#include "log.h"
+#include "main.h"
+#include "util.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static void module_battery(struct Module *module, char *text);
+static void module_clock(struct Module *module, char *text);
+static void module_cpu(struct Module *module, char *text);
+static void module_load(struct Module *module, char *text);
+static void module_memory(struct Module *module, char *text);
+static int module_open(const char *path);
+static ssize_t module_read(struct Module *module, int index);
+static void module_schedule(struct Module *module);
+static void module_timer(void *data);
+static int module_update(struct Module *module);
+
+void module_battery(struct Module *module, char *text) {
+    if (module_read(module, 0) <= 0)
+        return;
+    int capacity = atoi(module->buffer);
+
+    const char *charging = "";
+    if (module_read(module, 1) > 0)
+        charging = module->buffer[0] == 'C' ? "+" : module->buffer[0] == 'D' ? "-" : "";
+
+    snprintf(text, MODULE_TEXT, "%s%d%%%s", module->block->argument, capacity, charging);
+}
+
+void module_clock(struct Module *module, char *text) {
+    time_t now = time(NULL);
+    struct tm local;
+
+    if (!localtime_r(&now, &local) || strftime(text, MODULE_TEXT, module->block->argument, &local) == 0)
+        text[0] = '\0';
+}
+
+/* Busy time since the last sample, the first is the average since boot. */
+void module_cpu(struct Module *module, char *text) {
+    if (module_read(module, 0) <= 0 || strncmp(module->buffer, "cpu ", 4) != 0)
+        return;
+
+    /* user nice system idle iowait irq softirq steal */
+    uint64_t fields[8] = { 0 }, total = 0;
+    char *cursor = module->buffer + 4;
+    for (int i = 0; i < LENGTH(fields); i++) {
+        fields[i] = strtoull(cursor, &cursor, 10);
+        total += fields[i];
+    }
+    uint64_t idle = fields[3] + fields[4];
+
+    uint64_t total_delta = total - module->cpu_total, idle_delta = idle - module->cpu_idle;
+    module->cpu_total = total;
+    module->cpu_idle = idle;
+
+    int busy = total_delta ? (int)((total_delta - idle_delta) * 100 / total_delta) : 0;
+    snprintf(text, MODULE_TEXT, "%s%d%%", module->block->argument, busy);
+}
+
+void module_load(struct Module *module, char *text) {
+    if (module_read(module, 0) <= 0)
+        return;
+
+    snprintf(text, MODULE_TEXT, "%s%.2f", module->block->argument, strtod(module->buffer, NULL));
+}
+
+void module_memory(struct Module *module, char *text) {
+    if (module_read(module, 0) <= 0)
+        return;
+
+    char *total_line = strstr(module->buffer, "MemTotal:"), *available_line = strstr(module->buffer, "MemAvailable:");
+    if (!total_line || !available_line)
+        return;
+
+    unsigned long total = strtoul(total_line + strlen("MemTotal:"), NULL, 10),
+                  available = strtoul(available_line + strlen("MemAvailable:"), NULL, 10);
+    if (!total)
+        return;
+
+    snprintf(text, MODULE_TEXT, "%s%lu%%", module->block->argument, (total - available) * 100 / total);
+}
+
+int module_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        bar_log(LOG_ERROR, "Status module can't open %s: %s", path, strerror(errno));
+
+    return fd;
+}
+
+/* Reads the file from the start into the module's buffer, proc and sysfs files are regenerated on every read at 0. */
+ssize_t module_read(struct Module *module, int index) {
+    if (module->fds[index] < 0)
+        return -1;
+
+    ssize_t bytes = pread(module->fds[index], module->buffer, sizeof(module->buffer) - 1, 0);
+    module->buffer[bytes > 0 ? bytes : 0] = '\0';
+    return bytes;
+}
+
+/*
+ * Fires on the next multiple of the interval on the wall clock, so a clock ticks over with the second.
+ * It's worked out again every time, which also follows the wall clock being changed.
+ */
+void module_schedule(struct Module *module) {
+    unsigned int interval = module->block->interval ? module->block->interval : 1000;
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    uint64_t now_ms = (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    events_timer_set(module->timer, interval - now_ms % interval, 0);
+}
+
+void module_timer(void *data) {
+    struct Module *module = data;
+
+    module_schedule(module);
+    if (module_update(module))
+        module->modules->publish(module - module->modules->modules, module->text);
+}
+
+/* Returns non-zero if the block's text changed. */
+int module_update(struct Module *module) {
+    char text[MODULE_TEXT] = "";
+
+    switch (module->block->module) {
+        case Module_Clock:
+            module_clock(module, text);
+            break;
+        case Module_Battery:
+            module_battery(module, text);
+            break;
+        case Module_Cpu:
+            module_cpu(module, text);
+            break;
+        case Module_Memory:
+            module_memory(module, text);
+            break;
+        case Module_Load:
+            module_load(module, text);
+            break;
+    }
+
+    if (STRING_EQUAL(text, module->text))
+        return 0;
+
+    memcpy(module->text, text, sizeof(text));
+    return 1;
+}
+
+struct Modules *modules_create(struct Events *events, const struct StatusBlock *blocks, int length,
+        void (*publish)(int index, const char *text)) {
+    struct Modules *modules = ecalloc(1, sizeof(*modules));
+    modules->events = events;
+    modules->length = length;
+    modules->publish = publish;
+    modules->modules = ecalloc(length, sizeof(*modules->modules));
+
+    for (int i = 0; i < length; i++) {
+        struct Module *module = &modules->modules[i];
+        module->block = &blocks[i];
+        module->modules = modules;
+        module->fds[0] = module->fds[1] = -1;
+
+        switch (module->block->module) {
+            case Module_Battery: {
+                if (!module->block->device) {
+                    bar_log(LOG_ERROR, "Battery block without a device");
+                    break;
+                }
+                char *path = string_create("/sys/class/power_supply/%s/capacity", module->block->device);
+                module->fds[0] = module_open(path);
+                free(path);
+                path = string_create("/sys/class/power_supply/%s/status", module->block->device);
+                module->fds[1] = module_open(path);
+                free(path);
+                break;
+            }
+            case Module_Cpu:
+                module->fds[0] = module_open("/proc/stat");
+                break;
+            case Module_Memory:
+                module->fds[0] = module_open("/proc/meminfo");
+                break;
+            case Module_Load:
+                module->fds[0] = module_open("/proc/loadavg");
+                break;
+            default:
+                break;
+        }
+
+        module->timer = events_timer_add(events, module, module_timer);
+        module_schedule(module);
+
+        module_update(module);
+        modules->publish(i, module->text);
+    }
+
+    return modules;
+}
+
+void modules_destroy(struct Modules *modules) {
+    if (!modules)
+        return;
+
+    for (int i = 0; i < modules->length; i++) {
+        struct Module *module = &modules->modules[i];
+        events_timer_remove(modules->events, module->timer);
+        for (int j = 0; j < LENGTH(module->fds); j++)
+            if (module->fds[j] >= 0)
+                close(module->fds[j]);
+    }
+
+    free(modules->modules);
+    free(modules);
+}
@@ -0,0 +1,34 @@
+#ifndef MODULE_H_
+#define MODULE_H_
+
+#include "event.h"
+#include "user.h"
+#include <stdint.h>
+
+/* Longest text a single block shows */
+#define MODULE_TEXT 64
+
+/* One status block, updated in process on its own timer. */
+struct Module {
+    const struct StatusBlock *block;
+    struct Modules *modules;
+    struct EventTimer *timer;
+    int fds[2]; /* Files kept open and read from the start every update, -1 if unused */
+    char buffer[4096];
+    char text[MODULE_TEXT]; /* What the block shows, empty to leave it out */
+    uint64_t cpu_total, cpu_idle; /* Previous /proc/stat sample */
+};
+
+struct Modules {
+    struct Events *events;
+    struct Module *modules;
+    int length;
+    /* Called with a block's index and text whenever its text changed, each block has its own slot in the bar. */
+    void (*publish)(int index, const char *text);
+};
+
+struct Modules *modules_create(struct Events *events, const struct StatusBlock *blocks, int length,
+        void (*publish)(int index, const char *text));
+void modules_destroy(struct Modules *modules);
+
+#endif // MODULE_H_
@@ -0,0 +1,129 @@
+#include "parse.h"
+#include <string.h>
+
+static int parse_arguments(const char *cursor, struct ParsedLine *parsed);
+
+/* Commands are told apart by length and first letter, one memcmp confirms the guess. */
+enum Command command_lookup(struct Token name) {
+    enum Command command = Command_Unknown;
+    const char *expected = NULL;
+
+    if (name.length == 0)
+        return Command_Unknown;
+
+    switch (name.length) {
+        case 3:
+            command = Command_Get, expected = "get";
+            break;
+        case 4:
+            command = Command_Tags, expected = "tags";
+            break;
+        case 5:
+            if (name.start[0] == 't')
+                command = Command_Title, expected = "title";
+            else
+                command = Command_Appid, expected = "appid";
+            break;
+        case 6:
+            if (name.start[0] == 's') {
+                if (name.start[1] == 'e')
+                    command = Command_Selmon, expected = "selmon";
+                else
+                    command = Command_Status, expected = "status";
+            } else {
+                command = Command_Layout, expected = "layout";
+            }
+            break;
+        case 8:
+            command = Command_Floating, expected = "floating";
+            break;
+        case 10:
+            command = Command_Fullscreen, expected = "fullscreen";
+            break;
+        default:
+            return Command_Unknown;
+    }
+
+    return memcmp(name.start, expected, name.length) == 0 ? command : Command_Unknown;
+}
+
+int parse_arguments(const char *cursor, struct ParsedLine *parsed) {
+    switch (parsed->command) {
+        case Command_Title:
+        case Command_Appid:
+        case Command_Layout:
+        case Command_Status:
+            parsed->text = cursor;
+            break;
+        case Command_Floating:
+        case Command_Fullscreen:
+        case Command_Selmon:
+            parsed->value = token_to_uint(token_next(&cursor, ' '));
+            break;
+        case Command_Tags:
+            parsed->occupied = token_to_uint(token_next(&cursor, ' '));
+            parsed->tags     = token_to_uint(token_next(&cursor, ' '));
+            parsed->clients  = token_to_uint(token_next(&cursor, ' '));
+            parsed->urgent   = token_to_uint(token_next(&cursor, ' '));
+            break;
+        case Command_Get:
+            break;
+        default:
+            return -1;
+    }
+
+    return 0;
+}
+
+/* "<monitor> <command> <arguments>", returns -1 if the command isn't known. */
+int parse_dwl_line(const char *line, struct ParsedLine *parsed) {
+    const char *cursor = line;
+
+    parsed->monitor = token_next(&cursor, ' ');
+    parsed->command = command_lookup(token_next(&cursor, ' '));
+    if (parsed->command == Command_Status || parsed->command == Command_Get)
+        return -1;
+
+    return parse_arguments(cursor, parsed);
+}
+
+/* "<command> <arguments>", applies to every monitor. */
+int parse_fifo_line(const char *line, struct ParsedLine *parsed) {
+    const char *cursor = line;
+
+    parsed->monitor = (struct Token){ NULL, 0 };
+    parsed->command = command_lookup(token_next(&cursor, ' '));
+    if (parsed->command != Command_Status)
+        return -1;
+
+    return parse_arguments(cursor, parsed);
+}
+
+/* "<monitor|all> <command> <arguments>", any command. */
+int parse_ipc_line(const char *line, struct ParsedLine *parsed) {
+    const char *cursor = line;
+
+    parsed->monitor = token_next(&cursor, ' ');
+    parsed->command = command_lookup(token_next(&cursor, ' '));
+
+    return parse_arguments(cursor, parsed);
+}
+
+/* The text up to the next delimiter or the end of the line, the cursor moves past the delimiter. */
+struct Token token_next(const char **cursor, char delimiter) {
+    const char *start = *cursor, *end = start;
+
+    while (*end != '\0' && *end != '\n' && *end != delimiter)
+        end++;
+
+    *cursor = *end == delimiter ? end + 1 : end;
+    return (struct Token){ start, end - start };
+}
+
+uint32_t token_to_uint(struct Token token) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < token.length && token.start[i] >= '0' && token.start[i] <= '9'; i++)
+        value = value * 10 + (token.start[i] - '0');
+
+    return value;
+}
@@ -0,0 +1,45 @@
+#ifndef PARSE_H_
+#define PARSE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Non-owning view into a line, valid as long as the line is. */
+struct Token {
+    const char *start;
+    size_t length;
+};
+
+enum Command {
+    Command_Unknown,
+    /* From dwl on stdin, prefixed by the monitor's name */
+    Command_Title,
+    Command_Appid,
+    Command_Floating,
+    Command_Fullscreen,
+    Command_Selmon,
+    Command_Tags,
+    Command_Layout,
+    /* From the fifo */
+    Command_Status,
+    /* From the ipc socket, which takes every command */
+    Command_Get,
+};
+
+/* One line split into its fields, text points into the line itself. */
+struct ParsedLine {
+    struct Token monitor;
+    enum Command command;
+    const char *text;  /* Rest of the line for title, appid, layout and status, lines come without their newline */
+    uint32_t value;    /* floating, fullscreen and selmon */
+    uint32_t occupied, tags, clients, urgent;
+};
+
+enum Command command_lookup(struct Token name);
+int parse_dwl_line(const char *line, struct ParsedLine *parsed);
+int parse_fifo_line(const char *line, struct ParsedLine *parsed);
+int parse_ipc_line(const char *line, struct ParsedLine *parsed);
+struct Token token_next(const char **cursor, char delimiter);
+uint32_t token_to_uint(struct Token token);
+
+#endif // PARSE_H_
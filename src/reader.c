@@ -0,0 +1,84 @@
+#include "reader.h"
+#include "log.h"
+#include "util.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static void line_reader_split(struct LineReader *reader, size_t bytes, void (*handle)(const char *line));
+
+struct LineReader *line_reader_create(int fd, size_t max_line_length) {
+    struct LineReader *reader = ecalloc(1, sizeof(*reader));
+
+    reader->fd = fd;
+    /* Room for the newline, which becomes the line's NUL. */
+    reader->capacity = max_line_length + 1;
+    reader->buffer = ecalloc(reader->capacity, sizeof(*reader->buffer));
+
+    return reader;
+}
+
+void line_reader_destroy(struct LineReader *reader) {
+    if (!reader)
+        return;
+
+    if (reader->dropped)
+        bar_log(LOG_INFO, "Lines: %lu dropped for being too long", reader->dropped);
+    free(reader->buffer);
+    free(reader);
+}
+
+/* Reads until the fd would block, handing every complete line to `handle`. Returns -1 on end of file or error. */
+int line_reader_read(struct LineReader *reader, void (*handle)(const char *line)) {
+    while (1) {
+        ssize_t bytes = read(reader->fd, reader->buffer + reader->length, reader->capacity - reader->length);
+        if (bytes < 0) {
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK ? 0 : -1;
+        }
+
+        if (bytes == 0) {
+            /* The last line doesn't need a newline. */
+            if (reader->length > 0 && !reader->discarding) {
+                reader->buffer[reader->length] = '\0';
+                handle(reader->buffer);
+            }
+            reader->length = 0;
+            return -1;
+        }
+
+        line_reader_split(reader, bytes, handle);
+    }
+}
+
+void line_reader_split(struct LineReader *reader, size_t bytes, void (*handle)(const char *line)) {
+    char *line = reader->buffer, *newline,
+         *scan = reader->buffer + reader->length,
+         *end = scan + bytes;
+
+    /* Only the new bytes are scanned, the partial line before them is known not to hold a newline. */
+    while ((newline = memchr(scan, '\n', end - scan))) {
+        *newline = '\0';
+        if (reader->discarding)
+            reader->discarding = 0;
+        else
+            handle(line);
+        line = scan = newline + 1;
+    }
+
+    reader->length = end - line;
+    if (reader->length == reader->capacity) {
+        if (!reader->discarding) {
+            bar_log(LOG_ERROR, "Dropping a line longer than %zu bytes", reader->capacity - 1);
+            reader->dropped++;
+        }
+        reader->discarding = 1;
+        reader->length = 0;
+        return;
+    }
+
+    if (line != reader->buffer && reader->length > 0)
+        memmove(reader->buffer, line, reader->length);
+}
@@ -0,0 +1,19 @@
+#ifndef READER_H_
+#define READER_H_
+
+#include <stddef.h>
+
+/* Splits whatever arrives on a non-blocking fd into lines, keeping a partial line around until the rest shows up. */
+struct LineReader {
+    int fd;
+    char *buffer;
+    size_t length, capacity; /* Bytes of the unfinished line at the front of buffer */
+    int discarding;          /* Inside a line longer than the buffer, dropped up to its newline */
+    unsigned long dropped;
+};
+
+struct LineReader *line_reader_create(int fd, size_t max_line_length);
+void line_reader_destroy(struct LineReader *reader);
+int line_reader_read(struct LineReader *reader, void (*handle)(const char *line));
+
+#endif // READER_H_
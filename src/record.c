@@ -0,0 +1,203 @@
+#include "record.h"
+#include "input.h"
+#include "log.h"
+#include "main.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static void record_pointer_axis(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value);
+static void record_pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete);
+static void record_pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source);
+static void record_pointer_axis_stop(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis);
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+static void record_pointer_axis_value120(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t value120);
+#endif
+static void record_pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state);
+static void record_pointer_enter(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y);
+static void record_pointer_frame(void *data, struct wl_pointer *wl_pointer);
+static void record_pointer_leave(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface);
+static void record_pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y);
+static void record_touch_cancel(void *data, struct wl_touch *wl_touch);
+static void record_touch_down(void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time, struct wl_surface *surface, int32_t id, wl_fixed_t x, wl_fixed_t y);
+static void record_touch_frame(void *data, struct wl_touch *wl_touch);
+static void record_touch_motion(void *data, struct wl_touch *wl_touch, uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y);
+static void record_touch_orientation(void *data, struct wl_touch *wl_touch, int32_t id, wl_fixed_t orientation);
+static void record_touch_shape(void *data, struct wl_touch *wl_touch, int32_t id, wl_fixed_t major, wl_fixed_t minor);
+static void record_touch_up(void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time, int32_t id);
+static void record_write(enum RecordEvent event, struct wl_surface *surface, uint32_t time, int32_t arg0, int32_t arg1, int32_t arg2);
+
+static FILE *record_file = NULL;
+static struct timespec record_started;
+static unsigned long records = 0;
+
+/* Write the event down, then hand it to the real listener. */
+const struct wl_pointer_listener record_pointer_listener = {
+    .axis = record_pointer_axis,
+    .axis_discrete = record_pointer_axis_discrete,
+    .axis_source = record_pointer_axis_source,
+    .axis_stop = record_pointer_axis_stop,
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+    .axis_value120 = record_pointer_axis_value120,
+#endif
+    .button = record_pointer_button,
+    .enter = record_pointer_enter,
+    .frame = record_pointer_frame,
+    .leave = record_pointer_leave,
+    .motion = record_pointer_motion,
+};
+
+const struct wl_touch_listener record_touch_listener = {
+    .cancel = record_touch_cancel,
+    .down = record_touch_down,
+    .frame = record_touch_frame,
+    .motion = record_touch_motion,
+    .orientation = record_touch_orientation,
+    .shape = record_touch_shape,
+    .up = record_touch_up,
+};
+
+int record_is_active(void) {
+    return record_file != NULL;
+}
+
+void record_pointer_axis(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis, wl_fixed_t value) {
+    record_write(Record_Pointer_Axis, NULL, time, axis, value, 0);
+    pointer_listener.axis(data, wl_pointer, time, axis, value);
+}
+
+void record_pointer_axis_discrete(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t discrete) {
+    record_write(Record_Pointer_Axis_Discrete, NULL, 0, axis, discrete, 0);
+    pointer_listener.axis_discrete(data, wl_pointer, axis, discrete);
+}
+
+void record_pointer_axis_source(void *data, struct wl_pointer *wl_pointer, uint32_t axis_source) {
+    record_write(Record_Pointer_Axis_Source, NULL, 0, axis_source, 0, 0);
+    pointer_listener.axis_source(data, wl_pointer, axis_source);
+}
+
+void record_pointer_axis_stop(void *data, struct wl_pointer *wl_pointer, uint32_t time, uint32_t axis) {
+    record_write(Record_Pointer_Axis_Stop, NULL, time, axis, 0, 0);
+    pointer_listener.axis_stop(data, wl_pointer, time, axis);
+}
+
+#ifdef WL_POINTER_AXIS_VALUE120_SINCE_VERSION
+void record_pointer_axis_value120(void *data, struct wl_pointer *wl_pointer, uint32_t axis, int32_t value120) {
+    record_write(Record_Pointer_Axis_Value120, NULL, 0, axis, value120, 0);
+    pointer_listener.axis_value120(data, wl_pointer, axis, value120);
+}
+#endif
+
+void record_pointer_button(void *data, struct wl_pointer *wl_pointer, uint32_t serial, uint32_t time, uint32_t button, uint32_t state) {
+    record_write(Record_Pointer_Button, NULL, time, button, state, 0);
+    pointer_listener.button(data, wl_pointer, serial, time, button, state);
+}
+
+void record_pointer_enter(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface, wl_fixed_t surface_x, wl_fixed_t surface_y) {
+    record_write(Record_Pointer_Enter, surface, serial, surface_x, surface_y, 0);
+    pointer_listener.enter(data, wl_pointer, serial, surface, surface_x, surface_y);
+}
+
+void record_pointer_frame(void *data, struct wl_pointer *wl_pointer) {
+    record_write(Record_Pointer_Frame, NULL, 0, 0, 0, 0);
+    pointer_listener.frame(data, wl_pointer);
+}
+
+void record_pointer_leave(void *data, struct wl_pointer *wl_pointer, uint32_t serial, struct wl_surface *surface) {
+    record_write(Record_Pointer_Leave, surface, serial, 0, 0, 0);
+    pointer_listener.leave(data, wl_pointer, serial, surface);
+}
+
+void record_pointer_motion(void *data, struct wl_pointer *wl_pointer, uint32_t time, wl_fixed_t surface_x, wl_fixed_t surface_y) {
+    record_write(Record_Pointer_Motion, NULL, time, surface_x, surface_y, 0);
+    pointer_listener.motion(data, wl_pointer, time, surface_x, surface_y);
+}
+
+/* Starts writing every pointer and touch event received from here on into `path`. */
+int record_start(const char *path) {
+    if (record_file || !path)
+        return 0;
+
+    record_file = fopen(path, "wb");
+    if (!record_file)
+        return 0;
+
+    if (fwrite(RECORD_MAGIC, 1, strlen(RECORD_MAGIC), record_file) != strlen(RECORD_MAGIC)) {
+        fclose(record_file);
+        record_file = NULL;
+        return 0;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &record_started);
+    records = 0;
+    return 1;
+}
+
+void record_stop(void) {
+    if (!record_file)
+        return;
+
+    bar_log(LOG_INFO, "Recorded %lu input events", records);
+    fclose(record_file);
+    record_file = NULL;
+}
+
+void record_touch_cancel(void *data, struct wl_touch *wl_touch) {
+    record_write(Record_Touch_Cancel, NULL, 0, 0, 0, 0);
+    touch_listener.cancel(data, wl_touch);
+}
+
+void record_touch_down(void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time, struct wl_surface *surface, int32_t id, wl_fixed_t x, wl_fixed_t y) {
+    record_write(Record_Touch_Down, surface, time, id, x, y);
+    touch_listener.down(data, wl_touch, serial, time, surface, id, x, y);
+}
+
+void record_touch_frame(void *data, struct wl_touch *wl_touch) {
+    record_write(Record_Touch_Frame, NULL, 0, 0, 0, 0);
+    touch_listener.frame(data, wl_touch);
+}
+
+void record_touch_motion(void *data, struct wl_touch *wl_touch, uint32_t time, int32_t id, wl_fixed_t x, wl_fixed_t y) {
+    record_write(Record_Touch_Motion, NULL, time, id, x, y);
+    touch_listener.motion(data, wl_touch, time, id, x, y);
+}
+
+void record_touch_orientation(void *data, struct wl_touch *wl_touch, int32_t id, wl_fixed_t orientation) {
+    record_write(Record_Touch_Orientation, NULL, 0, id, orientation, 0);
+    touch_listener.orientation(data, wl_touch, id, orientation);
+}
+
+void record_touch_shape(void *data, struct wl_touch *wl_touch, int32_t id, wl_fixed_t major, wl_fixed_t minor) {
+    record_write(Record_Touch_Shape, NULL, 0, id, major, minor);
+    touch_listener.shape(data, wl_touch, id, major, minor);
+}
+
+void record_touch_up(void *data, struct wl_touch *wl_touch, uint32_t serial, uint32_t time, int32_t id) {
+    record_write(Record_Touch_Up, NULL, time, id, 0, 0);
+    touch_listener.up(data, wl_touch, serial, time, id);
+}
+
+/* Surfaces are only meaningful to this connection, they are written down as the output they belong to. */
+void record_write(enum RecordEvent event, struct wl_surface *surface, uint32_t time, int32_t arg0, int32_t arg1, int32_t arg2) {
+    if (!record_file)
+        return;
+
+    struct timespec now;
+    struct Monitor *monitor = surface ? monitor_from_surface(surface) : NULL;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    struct Record record = {
+        .timestamp = (uint64_t)(now.tv_sec - record_started.tv_sec) * 1000000000 + (now.tv_nsec - record_started.tv_nsec),
+        .event = event,
+        .monitor = monitor ? monitor->wl_name : RECORD_NO_MONITOR,
+        .time = time,
+        .args = { arg0, arg1, arg2 },
+    };
+
+    if (fwrite(&record, sizeof(record), 1, record_file) != 1) {
+        bar_log(LOG_ERROR, "Failed to write input recording, stopping");
+        record_stop();
+        return;
+    }
+    records++;
+}
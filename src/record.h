@@ -0,0 +1,49 @@
+#ifndef RECORD_H_
+#define RECORD_H_
+
+#include <stdint.h>
+#include <wayland-client.h>
+
+/* Every recording starts with this, followed by struct Record's in the order they were received. */
+#define RECORD_MAGIC "dwlbrec1"
+
+enum RecordEvent {
+    Record_Pointer_Enter,         /* time = serial, args = x, y */
+    Record_Pointer_Leave,         /* time = serial */
+    Record_Pointer_Motion,        /* args = x, y */
+    Record_Pointer_Button,        /* args = button, state */
+    Record_Pointer_Axis,          /* args = axis, value */
+    Record_Pointer_Frame,
+    Record_Pointer_Axis_Source,   /* args = source */
+    Record_Pointer_Axis_Stop,     /* args = axis */
+    Record_Pointer_Axis_Discrete, /* args = axis, discrete */
+    Record_Pointer_Axis_Value120, /* args = axis, value120 */
+    Record_Touch_Down,            /* args = id, x, y */
+    Record_Touch_Up,              /* args = id */
+    Record_Touch_Motion,          /* args = id, x, y */
+    Record_Touch_Frame,
+    Record_Touch_Cancel,
+    Record_Touch_Shape,           /* args = id, major, minor */
+    Record_Touch_Orientation,     /* args = id, orientation */
+    Record_Last,
+};
+
+/* One received input event, written to the recording as is, so recordings are only read back on the same architecture. */
+struct Record {
+    uint64_t timestamp; /* Nanoseconds since the recording started */
+    uint32_t event /* enum RecordEvent */,
+             monitor /* wl_name of the output whose surface the event was for, RECORD_NO_MONITOR if none */,
+             time /* The event's own timestamp in milliseconds */;
+    int32_t args[3];
+};
+
+#define RECORD_NO_MONITOR UINT32_MAX
+
+extern const struct wl_pointer_listener record_pointer_listener;
+extern const struct wl_touch_listener record_touch_listener;
+
+int record_is_active(void);
+int record_start(const char *path);
+void record_stop(void);
+
+#endif // RECORD_H_
@@ -3,19 +3,55 @@
 #include "main.h"
 #include "shm.h"
 #include "util.h"
+#include "worker.h"
 #include "config.h"
 #include "wlr-layer-shell-unstable-v1-protocol.h"
 #include "pango/pango-layout.h"
 #include "pango/pangocairo.h"
 #include <limits.h>
 #include <stdlib.h>
+#include <string.h>
 #include <wayland-client-protocol.h>
 #include <cairo.h>
+#include <unistd.h>
 
-static struct Font *get_font(void);
+static int basic_component_shape(struct BasicComponent *component, struct LayoutCache *cache);
+static struct Font *font_load(const char *name, PangoFontMap *map);
+static void *font_preload_thread(void *data);
 static void pipeline_frame(void* data, struct wl_callback* callback, uint32_t callback_data);
+static void pipeline_measure(struct Pipeline *pipeline);
 static void pipeline_layer_surface(void* data, struct zwlr_layer_surface_v1* _, uint32_t serial, uint32_t width, uint32_t height);
-static void pipeline_render(struct Pipeline *pipeline);
+static int pipeline_prepare(struct Pipeline *pipeline);
+static void pipeline_present(struct Pipeline *pipeline);
+static void pipeline_queue(struct Pipeline *pipeline);
+static void pipeline_rasterize(void *data);
+static void pipeline_request_frame(struct Pipeline *pipeline);
+static void pipeline_schedule(struct Pipeline *pipeline, uint64_t delay);
+static void pipeline_timer(void *data);
+static struct ThreadText *thread_text(void);
+static void thread_text_destroy(void *data);
+
+static struct wl_list fonts = { &fonts, &fonts }; /* struct Font* */
+/* A font being loaded on a helper thread by font_preload, handed over to the first font_acquire asking for it. */
+static struct {
+    pthread_t thread;
+    const char *name;
+    struct Font *font;
+    int loading;
+} preload;
+static struct List *ready; /* struct Pipeline*, waiting to be rendered */
+static struct WorkerPool *workers;
+/*
+ * Pango isn't thread safe and the fonts' contexts and layouts are shared between pipelines, so they belong
+ * to the main thread. Worker threads draw copies of the layouts made with their own context instead.
+ */
+struct ThreadText {
+    PangoContext *context;
+    struct LayoutCache *layouts;
+    PangoLayout *scratch; /* For layouts the cache can't hold, ellipsized or with attributes */
+};
+static pthread_t main_thread;
+static pthread_key_t thread_text_key;
 
 const struct wl_callback_listener frame_listener = {.done = pipeline_frame};
 const struct zwlr_layer_surface_v1_listener layer_surface_listener = {.configure = pipeline_layer_surface};
@@ -23,6 +59,7 @@ const struct zwlr_layer_surface_v1_listener layer_surface_listener = {.configure
 struct BasicComponent *basic_component_create(PangoContext *context, PangoFontDescription *description) {
     struct BasicComponent *component = ecalloc(1, sizeof(*component));
     component->layout = pango_layout_new(context);
+    component->description = description;
     pango_layout_set_font_description(component->layout, description);
     component->x = 0;
     component->y = 0;
@@ -30,6 +67,19 @@ struct BasicComponent *basic_component_create(PangoContext *context, PangoFontDe
     component->height = 0;
     component->tx = 0;
     component->ty = 0;
+    component->dirty = 1;
+    component->text_width = 0;
+    component->drawn = (struct Rect){ 0, 0, 0, 0 };
+    component->max_chars = 0;
+    component->text = NULL;
+    component->text_length = 0;
+    component->text_capacity = 0;
+    component->truncated = NULL;
+    component->truncated_capacity = 0;
+    component->text_max_chars = 0;
+    component->ellipsized = NULL;
+    component->ellipsize = 0;
+    component->ellipsized_width = 0;
 
     return component;
 }
@@ -39,53 +89,238 @@ void basic_component_destroy(struct BasicComponent *component) {
         return;
 
     g_object_unref(component->layout);
+    if (component->ellipsized)
+        g_object_unref(component->ellipsized);
+    free(component->text);
+    free(component->truncated);
     free(component);
 }
 
-int basic_component_is_clicked(struct BasicComponent *component, double x, double y) {
-    return (x > component->x && y > component->y &&
-            x < (component->x + component->width) && y < (component->y + component->height));
+/*
+ * Makes the text fit into `width` pixels, ellipsizing the end using the real glyph extents if it
+ * doesn't already. The ellipsized layout is only reshaped when the text or width changes.
+ * Returns the width of the text as it will be drawn.
+ */
+int basic_component_fit(struct BasicComponent *component, int width) {
+    if (!component)
+        return 0;
+    if (width < 0)
+        width = 0;
+
+    if (component->text_width <= width) {
+        if (component->ellipsize) {
+            component->ellipsize = 0;
+            component->dirty = 1;
+        }
+        return component->text_width;
+    }
+
+    if (component->ellipsize && component->ellipsized_width == width)
+        return width;
+
+    if (!component->ellipsized) {
+        component->ellipsized = pango_layout_new(pango_layout_get_context(component->layout));
+        pango_layout_set_font_description(component->ellipsized, component->description);
+        pango_layout_set_single_paragraph_mode(component->ellipsized, 1);
+        pango_layout_set_ellipsize(component->ellipsized, PANGO_ELLIPSIZE_END);
+    }
+
+    pango_layout_set_text(component->ellipsized, pango_layout_get_text(component->layout), -1);
+    pango_layout_set_width(component->ellipsized, width * PANGO_SCALE);
+    component->ellipsized_width = width;
+    component->ellipsize = 1;
+    component->dirty = 1;
+
+    return width;
+}
+
+/*
+ * Moves the component to x, y and decides whether it needs to be drawn, which is when it is dirty,
+ * has moved or the pipeline is redrawing. If so its old and new bounds are damaged.
+ */
+int basic_component_damage(struct BasicComponent *component, struct Pipeline *pipeline, int x, int y) {
+    if (!component || !pipeline)
+        return 0;
+
+    component->x = x;
+    component->y = y;
+
+    struct Rect rect = { x, y, component->width, component->height };
+    int moved = rect.x != component->drawn.x || rect.y != component->drawn.y ||
+        rect.width != component->drawn.width || rect.height != component->drawn.height;
+    if (!component->dirty && !moved && !pipeline->redraw)
+        return 0;
+
+    if (moved)
+        pipeline_damage(pipeline, &component->drawn);
+    pipeline_damage(pipeline, &rect);
+    component->drawn = rect;
+    component->dirty = 0;
+
+    return 1;
 }
 
-void basic_component_render(struct BasicComponent *component, struct Pipeline *pipeline,
+/*
+ * Draws the component if it is dirty, has moved or the pipeline is redrawing.
+ * Returns non-zero if anything was drawn so callers know whether to draw their decorations.
+ */
+int basic_component_render(struct BasicComponent *component, struct Pipeline *pipeline,
         cairo_t *painter, int *x, int *y) {
-    if (!component)
-        return;
+    if (!component || !basic_component_damage(component, pipeline, *x, *y))
+        return 0;
 
-    pango_cairo_update_layout(painter, component->layout);
-    component->x = *x;
-    component->y = *y;
+    cairo_save(painter);
+    cairo_rectangle(painter, *x, *y, component->width, component->height);
+    cairo_clip(painter);
 
     pipeline_color_background(pipeline, painter);
-    cairo_rectangle(painter, *x, *y, component->width, component->height);
-    cairo_fill(painter);
+    cairo_paint(painter);
 
     pipeline_color_foreground(pipeline, painter);
     cairo_move_to(painter, *x+component->tx, *y+component->ty);
-    pango_cairo_show_layout(painter, component->layout);
+    pipeline_show_layout(painter, component->ellipsize ? component->ellipsized : component->layout);
+    cairo_restore(painter);
+
+    return 1;
+}
+
+/*
+ * Limits the text to `max_chars` characters, reshaping what is already set right away so the limit
+ * holds from the frame it is learned in rather than from the next time the text changes.
+ */
+void basic_component_set_max_chars(struct BasicComponent *component, struct LayoutCache *cache, size_t max_chars) {
+    if (!component || component->max_chars == max_chars)
+        return;
+
+    component->max_chars = max_chars;
+    if (component->text && component->text_max_chars != max_chars) {
+        component->text_max_chars = max_chars;
+        basic_component_shape(component, cache);
+    }
+}
+
+/*
+ * Sets the component's text, shaped through the layout cache.
+ * Text identical to what was last set returns straight away, the copy kept of it is only compared when the
+ * lengths match.
+ * Returns non-zero if the layout changed.
+ */
+int basic_component_set_text(struct BasicComponent *component, struct LayoutCache *cache, const char *text) {
+    if (!component || !cache || !text)
+        return 0;
+
+    size_t length = strlen(text);
+    if (length == component->text_length && component->max_chars == component->text_max_chars
+            && component->text && memcmp(text, component->text, length) == 0)
+        return 0;
+
+    if (length + 1 > component->text_capacity) {
+        component->text_capacity = length + 1 > component->text_capacity * 2 ? length + 1 : component->text_capacity * 2;
+        if (!(component->text = realloc(component->text, component->text_capacity)))
+            panic("Out of memory");
+    }
+    memcpy(component->text, text, length + 1);
+    component->text_length = length;
+    component->text_max_chars = component->max_chars;
+
+    return basic_component_shape(component, cache);
+}
+
+/*
+ * Swaps the component's layout for the cached one shaped for its text. Text longer than `max_chars` is cut
+ * there and ends in an ellipsis, so nothing that could never be on screen is shaped.
+ * Returns non-zero if the layout changed.
+ */
+int basic_component_shape(struct BasicComponent *component, struct LayoutCache *cache) {
+    if (!cache)
+        return 0;
+
+    const char *text = component->text, *end = text;
+    if (component->max_chars) {
+        /* Step over continuation bytes by hand so a truncated sequence can't skip the terminator. */
+        for (size_t i = 0; i < component->max_chars && *end; i++)
+            do end++; while ((*end & 0xC0) == 0x80);
+    } else
+        end += strlen(text);
+
+    size_t length = end - text;
+    if (*end) {
+        if (length + sizeof(ELLIPSIS) > component->truncated_capacity) {
+            component->truncated_capacity = length + sizeof(ELLIPSIS);
+            if (!(component->truncated = realloc(component->truncated, component->truncated_capacity)))
+                panic("Out of memory");
+        }
+        memcpy(component->truncated, text, length);
+        memcpy(component->truncated + length, ELLIPSIS, sizeof(ELLIPSIS));
+        text = component->truncated;
+        length += sizeof(ELLIPSIS) - 1;
+    }
+
+    int width;
+    PangoLayout *layout = layout_cache_get(cache, component->description, text, length, &width);
+    if (!layout)
+        return 0;
+
+    if (layout == component->layout) {
+        g_object_unref(layout);
+        return 0;
+    }
+
+    g_object_unref(component->layout);
+    component->layout = layout;
+    component->text_width = width;
+    component->ellipsize = 0;
+    component->dirty = 1;
+    return 1;
 }
 
 int basic_component_text_width(struct BasicComponent *component) {
     if (!component)
         return 0;
 
-    int w;
-    pango_layout_get_size(component->layout, &w, NULL);
-    return PANGO_PIXELS(w);
+    return component->text_width;
+}
+
+/*
+ * Fonts are shared by every pipeline using the same font string, along with their context and layout cache,
+ * so additional outputs don't have to go through fontconfig again.
+ */
+struct Font *font_acquire(const char *name) {
+    struct Font *font;
+    wl_list_for_each(font, &fonts, link) {
+        if (!STRING_EQUAL(font->name, name))
+            continue;
+
+        font->references++;
+        return font;
+    }
+
+    if (preload.loading && STRING_EQUAL(preload.name, name)) {
+        uint64_t waiting = time_us();
+        pthread_join(preload.thread, NULL);
+        preload.loading = 0;
+        font = preload.font;
+        bar_log(LOG_INFO, "Waited %.1f ms for %s to finish loading", (time_us() - waiting) / 1000.0, name);
+    } else {
+        font = font_load(name, pango_cairo_font_map_get_default());
+    }
+
+    wl_list_insert(&fonts, &font->link);
+    return font;
 }
 
-struct Font *get_font(void) {
-    PangoFontMap* map = pango_cairo_font_map_get_default();
+/* Goes through fontconfig for the font, which is most of the time startup takes. */
+struct Font *font_load(const char *name, PangoFontMap *map) {
     if (!map)
         panic("font map");
 
-    PangoFontDescription* desc = pango_font_description_from_string(font);
+    PangoFontDescription* desc = pango_font_description_from_string(name);
     if (!desc)
         panic("font description");
 
     PangoContext* context = pango_font_map_create_context(map);
     if (!context)
-        panic("temp context");
+        panic("font context");
 
     PangoFont* fnt = pango_font_map_load_font(map, context, desc);
     if (!fnt)
@@ -96,17 +331,84 @@ struct Font *get_font(void) {
         panic("font metrics");
 
     struct Font *font = ecalloc(1, sizeof(*font));
+    font->name = strdup(name);
     font->description = desc;
+    font->context = context;
+    font->layouts = layout_cache_create(context, layout_cache_size);
     font->height = PANGO_PIXELS(pango_font_metrics_get_height(metrics));
     font->approx_width = PANGO_PIXELS(pango_font_metrics_get_approximate_char_width(metrics));
+    font->references = 1;
 
     pango_font_metrics_unref(metrics);
     g_object_unref(fnt);
-    g_object_unref(context);
 
     return font;
 }
 
+/* Starts loading the font on a helper thread, so fontconfig runs while the compositor is still being talked to. */
+void font_preload(const char *name) {
+    if (preload.loading || !name)
+        return;
+
+    preload.name = name;
+    preload.font = NULL;
+    if (pthread_create(&preload.thread, NULL, font_preload_thread, NULL) != 0) {
+        bar_log(LOG_ERROR, "Couldn't start loading %s ahead of time", name);
+        return;
+    }
+    preload.loading = 1;
+}
+
+/*
+ * Default font maps belong to the thread asking for them, the font is handed to the main thread so it gets a map
+ * of its own. Its context keeps the map alive.
+ */
+void *font_preload_thread(void *data) {
+    PangoFontMap *map = pango_cairo_font_map_new();
+    struct Font *font = font_load(preload.name, map);
+    g_object_unref(map);
+
+    /* Shapes every printable ASCII character once, so the glyphs the bar draws first are already cached. */
+    PangoLayout *layout = pango_layout_new(font->context);
+    pango_layout_set_font_description(layout, font->description);
+    char ascii[95];
+    for (int i = 0; i < LENGTH(ascii) - 1; i++)
+        ascii[i] = ' ' + 1 + i;
+    ascii[LENGTH(ascii) - 1] = '\0';
+    pango_layout_set_text(layout, ascii, -1);
+    pango_layout_get_pixel_size(layout, NULL, NULL);
+    g_object_unref(layout);
+
+    preload.font = font;
+    return NULL;
+}
+
+/* Waits for a preload nobody asked for, so the thread and its font don't outlive the bar. */
+void font_preload_stop(void) {
+    if (!preload.loading)
+        return;
+
+    pthread_join(preload.thread, NULL);
+    preload.loading = 0;
+    wl_list_insert(&fonts, &preload.font->link);
+    font_release(preload.font);
+}
+
+void font_release(struct Font *font) {
+    if (!font || --font->references > 0)
+        return;
+
+    bar_log(LOG_INFO, "Layout cache for %s: %lu hits, %lu misses", font->name,
+            font->layouts->hits, font->layouts->misses);
+
+    wl_list_remove(&font->link);
+    layout_cache_destroy(font->layouts);
+    g_object_unref(font->context);
+    pango_font_description_free(font->description);
+    free(font->name);
+    free(font);
+}
+
 void pipeline_add(struct Pipeline *pipeline, const struct PipelineListener *listener, void *data) {
     if (!pipeline)
         return;
@@ -114,16 +416,93 @@ void pipeline_add(struct Pipeline *pipeline, const struct PipelineListener *list
     struct PipelineCallback *callback = list_add(pipeline->callbacks, ecalloc(1, sizeof(*callback)));
     callback->listener = listener;
     callback->data = data;
+    callback->width = 0;
+    callback->future = 0;
+}
+
+/* Copies a pre-rendered ARGB32 image straight into the buffer being drawn, row by row. */
+void pipeline_blit(struct Pipeline *pipeline, cairo_t *painter, cairo_surface_t *image, int x, int y) {
+    if (!image)
+        return;
+
+    struct Rect source = { 0, 0, cairo_image_surface_get_width(image), cairo_image_surface_get_height(image) };
+    pipeline_blit_rect(pipeline, painter, image, &source, x, y);
+}
+
+/* Like pipeline_blit, but only copies the `source` part of the image. */
+void pipeline_blit_rect(struct Pipeline *pipeline, cairo_t *painter, cairo_surface_t *image,
+        const struct Rect *source, int x, int y) {
+    if (!pipeline || !pipeline->shm || !painter || !image || !source)
+        return;
+
+    cairo_surface_t *target = cairo_get_target(painter);
+    const uint8_t *from = cairo_image_surface_get_data(image);
+    uint8_t *dest = cairo_image_surface_get_data(target);
+    int source_stride = cairo_image_surface_get_stride(image),
+        dest_stride = cairo_image_surface_get_stride(target),
+        width = source->width,
+        height = source->height;
+
+    if (x < 0 || y < 0 || source->x < 0 || source->y < 0 || !from || !dest)
+        return;
+    if (source->x + width > cairo_image_surface_get_width(image))
+        width = cairo_image_surface_get_width(image) - source->x;
+    if (source->y + height > cairo_image_surface_get_height(image))
+        height = cairo_image_surface_get_height(image) - source->y;
+    if (x + width > pipeline->shm->width)
+        width = pipeline->shm->width - x;
+    if (y + height > pipeline->shm->height)
+        height = pipeline->shm->height - y;
+    if (width <= 0 || height <= 0)
+        return;
+
+    /* Make sure cairo has nothing pending for the target before writing behind its back. */
+    cairo_surface_flush(target);
+    from += source->y * source_stride + source->x * 4;
+    dest += y * dest_stride + x * 4;
+    for (int row = 0; row < height; row++, from += source_stride, dest += dest_stride)
+        memcpy(dest, from, width * 4);
+    cairo_surface_mark_dirty_rectangle(target, x, y, width, height);
+}
+
+/* Input just happened, whatever it causes should be drawn without waiting. */
+void pipeline_boost(struct Pipeline *pipeline) {
+    if (!pipeline)
+        return;
+
+    pipeline->boost_until = time_ms() + PIPELINE_INPUT_WINDOW;
 }
 
-struct Pipeline *pipeline_create(void) {
+void pipeline_damage(struct Pipeline *pipeline, const struct Rect *rect) {
+    if (!pipeline || !pipeline->shm || !rect)
+        return;
+
+    shm_damage(pipeline->shm, rect->x, rect->y, rect->width, rect->height);
+}
+
+struct Pipeline *pipeline_create(struct Events *events) {
     struct Pipeline *pipeline = ecalloc(1, sizeof(*pipeline));
     pipeline->callbacks = list_create(0);
     pipeline->current = 0;
     pipeline->invalid = 0;
-    pipeline->context = pango_font_map_create_context(pango_cairo_font_map_get_default());
-    pipeline->font = get_font();
+    pipeline->redraw = 1;
+    pipeline->queued = 0;
+    pipeline->font = font_acquire(font);
+    pipeline->context = pipeline->font->context;
+    pipeline->layouts = pipeline->font->layouts;
     pipeline->shm = NULL;
+    pipeline->regions = NULL;
+    pipeline->regions_length = 0;
+    pipeline->regions_capacity = 0;
+
+    /* Without events, as in the benchmarks, nothing is ever scheduled. */
+    pipeline->events = events;
+    pipeline->timer = events_timer_add(events, pipeline, pipeline_timer);
+    pipeline->scheduled = 0;
+    pipeline->last_frame = 0;
+    pipeline->boost_until = 0;
+    pipeline->frames_requested = 0;
+    pipeline->frames_rendered = 0;
 
     return pipeline;
 }
@@ -132,33 +511,36 @@ void pipeline_destroy(struct Pipeline *pipeline) {
     if (!pipeline)
         return;
 
+    bar_log(LOG_INFO, "Frames: %lu requested, %lu rendered", pipeline->frames_requested, pipeline->frames_rendered);
+
+    int index = list_find(ready, pipeline);
+    if (index != -1)
+        list_remove(ready, index);
+
     list_elements_destroy(pipeline->callbacks, free);
-    g_object_unref(pipeline->context);
-    pango_font_description_free(pipeline->font->description);
-    free(pipeline->font);
+    free(pipeline->regions);
+    events_timer_remove(pipeline->events, pipeline->timer);
+    font_release(pipeline->font);
     shm_destroy(pipeline->shm);
-    wl_surface_destroy(pipeline->surface);
-    zwlr_layer_surface_v1_destroy(pipeline->layer_surface);
+    if (pipeline->layer_surface)
+        zwlr_layer_surface_v1_destroy(pipeline->layer_surface);
+    if (pipeline->surface)
+        wl_surface_destroy(pipeline->surface);
     free(pipeline);
 }
 
 void pipeline_frame(void* data, struct wl_callback* callback, uint32_t callback_data) {
-    pipeline_render((struct Pipeline *)data);
+    pipeline_queue((struct Pipeline *)data);
     wl_callback_destroy(callback);
 }
 
+/* The width of every callback after the one being rendered, as of the last measure pass. */
 int pipeline_get_future_widths(struct Pipeline *pipeline) {
-    if (!pipeline)
+    if (!pipeline || pipeline->current >= pipeline->callbacks->length)
         return 0;
 
-    int width = 0;
-    struct PipelineCallback *callback;
-    for (int i = pipeline->callbacks->length-1; i > pipeline->current; i--) {
-        callback = pipeline->callbacks->data[i];
-        width += callback->listener->width(pipeline, callback->data, width);
-    }
-
-    return width;
+    struct PipelineCallback *callback = pipeline->callbacks->data[pipeline->current];
+    return callback->future;
 }
 
 void pipeline_hide(struct Pipeline *pipeline) {
@@ -173,16 +555,41 @@ void pipeline_hide(struct Pipeline *pipeline) {
     pipeline->layer_surface = NULL;
     pipeline->surface = NULL;
     pipeline->shm = NULL;
+    pipeline_schedule(pipeline, 0);
 }
 
+/*
+ * Asks for the pipeline to be redrawn. Invalidations arriving close together are merged into one
+ * frame, coalesce_delay milliseconds after the first, and frames are kept at most max_fps apart.
+ * Shortly after input frames are requested immediately instead.
+ */
 void pipeline_invalidate(struct Pipeline *pipeline) {
-    if (!pipeline || pipeline->invalid || !pipeline_is_visible(pipeline))
+    if (!pipeline || !pipeline_is_visible(pipeline))
         return;
 
-    struct wl_callback *callback = wl_surface_frame(pipeline->surface);
-    wl_callback_add_listener(callback, &frame_listener, pipeline);
-    wl_surface_commit(pipeline->surface);
-    pipeline->invalid = 1;
+    pipeline->frames_requested++;
+    if (pipeline->invalid)
+        return;
+
+    uint64_t now = time_ms(), deadline = now + coalesce_delay;
+    if (now < pipeline->boost_until) {
+        pipeline_schedule(pipeline, 0);
+        pipeline_request_frame(pipeline);
+        return;
+    }
+
+    if (pipeline->scheduled)
+        return;
+
+    if (max_fps && pipeline->last_frame + 1000 / max_fps > deadline)
+        deadline = pipeline->last_frame + 1000 / max_fps;
+
+    if (deadline <= now) {
+        pipeline_request_frame(pipeline);
+        return;
+    }
+
+    pipeline_schedule(pipeline, deadline - now);
 }
 
 int pipeline_is_visible(struct Pipeline *pipeline) {
@@ -202,35 +609,215 @@ void pipeline_layer_surface(void* data, struct zwlr_layer_surface_v1* _,
     }
 
     pipeline->shm = shm_create(width, height, WL_SHM_FORMAT_XRGB8888);
-    pipeline_render(pipeline);
+    pipeline->redraw = 1;
+    pipeline_queue(pipeline);
 }
 
-void pipeline_render(struct Pipeline *pipeline) {
+/*
+ * Measure every callback once, back to front, so each knows how much room the ones after it need.
+ * Rendering only reads these results.
+ */
+void pipeline_measure(struct Pipeline *pipeline) {
+    struct PipelineCallback *callback;
+    int future = 0;
+
+    for (int i = pipeline->callbacks->length-1; i >= 0; i--) {
+        callback = pipeline->callbacks->data[i];
+        callback->future = future;
+        callback->width = callback->listener->width(pipeline, callback->data, future);
+        future += callback->width;
+    }
+}
+
+/*
+ * Picks and repairs a buffer, then measures. Runs on the main thread.
+ * Returns 0 if there is nothing to draw into this time.
+ */
+int pipeline_prepare(struct Pipeline *pipeline) {
     if (!pipeline || !pipeline->shm)
+        return 0;
+
+    if (!shm_next(pipeline->shm)) {
+        /* The compositor is still reading from every buffer, try again next frame. */
+        pipeline->invalid = 0;
+        pipeline_request_frame(pipeline);
+        return 0;
+    }
+
+    /*
+     * The context takes the font options of every new painter, whether its buffer came with the shm or was
+     * allocated later. Layouts notice the context changed on their own.
+     */
+    struct Buffer *buffer = pipeline->shm->current;
+    if (buffer->fresh) {
+        buffer->fresh = 0;
+        pango_cairo_update_context(buffer->painter, pipeline->context);
+    }
+
+    if (!shm_repair(pipeline->shm))
+        pipeline->redraw = 1;
+    if (pipeline->redraw)
+        shm_damage(pipeline->shm, 0, 0, pipeline->shm->width, pipeline->shm->height);
+
+    pipeline_measure(pipeline);
+    return 1;
+}
+
+/* Hands the drawn buffer to the compositor, if anything changed. Runs on the main thread. */
+void pipeline_present(struct Pipeline *pipeline) {
+    pipeline->invalid = 0;
+    pipeline->redraw = 0;
+    pipeline->last_frame = time_ms();
+
+    struct Damage *damage = shm_frame_damage(pipeline->shm);
+    if (!damage->full && damage->length == 0)
+        return;
+
+    wl_surface_attach(pipeline->surface, shm_buffer(pipeline->shm), 0, 0);
+    if (damage->full)
+        wl_surface_damage_buffer(pipeline->surface, 0, 0, pipeline->shm->width, pipeline->shm->height);
+    else
+        for (int i = 0; i < damage->length; i++)
+            wl_surface_damage_buffer(pipeline->surface, damage->rects[i].x, damage->rects[i].y,
+                    damage->rects[i].width, damage->rects[i].height);
+    wl_surface_commit(pipeline->surface);
+
+    shm_flip(pipeline->shm);
+    pipeline->frames_rendered++;
+}
+
+void pipeline_queue(struct Pipeline *pipeline) {
+    if (!ready)
+        ready = list_create(0);
+
+    if (pipeline->queued)
         return;
 
+    list_add(ready, pipeline);
+    pipeline->queued = 1;
+}
+
+/*
+ * Draws every callback into the prepared buffer. Only touches this pipeline's own state, so separate
+ * pipelines can be rasterized on separate threads.
+ */
+void pipeline_rasterize(void *data) {
+    struct Pipeline *pipeline = data;
+    cairo_t *painter = shm_painter(pipeline->shm);
     int x = 0, y = 0;
-    cairo_surface_t *image = cairo_image_surface_create_for_data(shm_data(pipeline->shm),
-            CAIRO_FORMAT_ARGB32, pipeline->shm->width, pipeline->shm->height, pipeline->shm->stride);
-    cairo_t *painter = cairo_create(image);
-    pango_cairo_update_context(painter, pipeline->context);
 
+    pipeline->regions_length = 0;
     struct PipelineCallback *callback;
     for (int i = 0; i < pipeline->callbacks->length; i++) {
         pipeline->current = i;
         callback = pipeline->callbacks->data[i];
         callback->listener->render(pipeline, callback->data, painter, &x, &y);
     }
+}
 
-    wl_surface_attach(pipeline->surface, shm_buffer(pipeline->shm), 0, 0);
-    wl_surface_damage(pipeline->surface, 0, 0, pipeline->shm->width, pipeline->shm->height);
-    wl_surface_commit(pipeline->surface);
+/* Finds the region under x as of the last frame drawn, or NULL if there is none. */
+const struct Region *pipeline_region_at(struct Pipeline *pipeline, double x) {
+    if (!pipeline)
+        return NULL;
+
+    int low = 0, high = pipeline->regions_length - 1, middle;
+    struct Region *region;
+    while (low <= high) {
+        middle = low + (high - low) / 2;
+        region = &pipeline->regions[middle];
+        if (x < region->start)
+            high = middle - 1;
+        else if (x >= region->end)
+            low = middle + 1;
+        else
+            return region;
+    }
 
-    cairo_destroy(painter);
-    cairo_surface_destroy(image);
+    return NULL;
+}
+
+/*
+ * Publishes [start, end) as belonging to `hotspot` for the frame being drawn.
+ * Regions have to be added left to right, which rendering already goes in.
+ */
+void pipeline_region_add(struct Pipeline *pipeline, struct Hotspot *hotspot, int start, int end, int location, int index) {
+    if (!pipeline || end <= start)
+        return;
+    if (pipeline->regions_length && start < pipeline->regions[pipeline->regions_length-1].end)
+        return;
+
+    if (pipeline->regions_length == pipeline->regions_capacity) {
+        pipeline->regions_capacity = pipeline->regions_capacity ? pipeline->regions_capacity * 2 : 16;
+        pipeline->regions = realloc(pipeline->regions, sizeof(*pipeline->regions) * pipeline->regions_capacity);
+        if (!pipeline->regions)
+            panic("Out of memory");
+    }
+
+    pipeline->regions[pipeline->regions_length++] = (struct Region){ start, end, hotspot, location, index };
+}
+
+/*
+ * Renders every pipeline that got a frame callback or configure since the last call.
+ * Rasterization is spread across the worker threads, if there are any,
+ * everything touching Wayland stays on the main thread.
+ */
+void pipeline_render_ready(void) {
+    if (!ready || ready->length == 0)
+        return;
+
+    struct Pipeline *pipeline;
+    size_t length = 0;
+    for (size_t i = 0; i < ready->length; i++) {
+        pipeline = ready->data[i];
+        pipeline->queued = 0;
+        if (pipeline_prepare(pipeline))
+            ready->data[length++] = pipeline;
+    }
+    ready->length = length;
+
+    worker_pool_run(workers, pipeline_rasterize, ready->data, ready->length);
+
+    for (size_t i = 0; i < ready->length; i++)
+        pipeline_present(ready->data[i]);
+    ready->length = 0;
+}
+
+/*
+ * Draws a frame into the pipeline's offscreen buffers right away, the same way pipeline_render_ready would,
+ * minus everything that involves the compositor. The finished frame is left in pipeline->shm->previous.
+ * Returns 0 if nothing was drawn.
+ */
+int pipeline_render_offscreen(struct Pipeline *pipeline) {
+    if (!pipeline || !pipeline->shm || !pipeline->shm->offscreen || !pipeline_prepare(pipeline))
+        return 0;
+
+    pipeline_rasterize(pipeline);
 
-    shm_flip(pipeline->shm);
     pipeline->invalid = 0;
+    pipeline->redraw = 0;
+    pipeline->last_frame = time_ms();
+    shm_flip(pipeline->shm);
+    pipeline->frames_rendered++;
+    return 1;
+}
+
+void pipeline_request_frame(struct Pipeline *pipeline) {
+    if (!pipeline || pipeline->invalid || !pipeline_is_visible(pipeline))
+        return;
+
+    struct wl_callback *callback = wl_surface_frame(pipeline->surface);
+    wl_callback_add_listener(callback, &frame_listener, pipeline);
+    wl_surface_commit(pipeline->surface);
+    pipeline->invalid = 1;
+}
+
+/* Arms the pipeline's timer to request a frame in `delay` milliseconds, a delay of 0 disarms it. */
+void pipeline_schedule(struct Pipeline *pipeline, uint64_t delay) {
+    if (!pipeline->timer || (!delay && !pipeline->scheduled))
+        return;
+
+    events_timer_set(pipeline->timer, delay, 0);
+    pipeline->scheduled = delay != 0;
 }
 
 void pipeline_show(struct Pipeline *pipeline, struct wl_output *output) {
@@ -252,6 +839,77 @@ void pipeline_show(struct Pipeline *pipeline, struct wl_output *output) {
     wl_surface_commit(pipeline->surface);
 }
 
+/* Gives the pipeline `width` by `height` of plain memory to draw into instead of a surface, for drawing without a compositor. */
+void pipeline_show_offscreen(struct Pipeline *pipeline, int width, int height) {
+    if (!pipeline || pipeline->shm || pipeline_is_visible(pipeline))
+        return;
+
+    pipeline->shm = shm_create_offscreen(width, height);
+    pipeline->redraw = 1;
+}
+
+/* Draws the layout at the current point, off the main thread a copy of it is drawn, see struct ThreadText. */
+void pipeline_show_layout(cairo_t *painter, PangoLayout *layout) {
+    if (!workers || pthread_equal(pthread_self(), main_thread)) {
+        pango_cairo_show_layout(painter, layout);
+        return;
+    }
+
+    struct ThreadText *text = thread_text();
+    const PangoFontDescription *description = pango_layout_get_font_description(layout);
+    PangoAttrList *attributes = pango_layout_get_attributes(layout);
+    PangoLayout *copy;
+
+    /* Only changes the context if the surface's font options differ from the last one's. */
+    pango_cairo_update_context(painter, text->context);
+
+    if (description && !attributes && pango_layout_get_width(layout) < 0) {
+        const char *string = pango_layout_get_text(layout);
+        copy = layout_cache_get(text->layouts, description, string, strlen(string), NULL);
+    } else {
+        copy = g_object_ref(text->scratch);
+        pango_layout_set_font_description(copy, description);
+        pango_layout_set_attributes(copy, attributes);
+        pango_layout_set_single_paragraph_mode(copy, pango_layout_get_single_paragraph_mode(layout));
+        pango_layout_set_ellipsize(copy, pango_layout_get_ellipsize(layout));
+        pango_layout_set_width(copy, pango_layout_get_width(layout));
+        pango_layout_set_text(copy, pango_layout_get_text(layout), -1);
+    }
+
+    pango_cairo_show_layout(painter, copy);
+    g_object_unref(copy);
+}
+
+void pipeline_timer(void *data) {
+    struct Pipeline *pipeline = data;
+
+    pipeline->scheduled = 0;
+    pipeline_request_frame(pipeline);
+}
+
+/* Start `threads` threads to rasterize alongside the main thread, 0 keeps rendering single threaded. */
+void pipeline_workers_start(int threads) {
+    if (workers || threads <= 0)
+        return;
+
+    main_thread = pthread_self();
+    if (pthread_key_create(&thread_text_key, thread_text_destroy) != 0)
+        panic("pthread_key_create");
+
+    workers = worker_pool_create(threads);
+    bar_log(LOG_INFO, "Rasterizing on %d extra threads", threads);
+}
+
+void pipeline_workers_stop(void) {
+    if (!workers)
+        return;
+
+    /* Joins the threads, which frees their ThreadText. */
+    worker_pool_destroy(workers);
+    workers = NULL;
+    pthread_key_delete(thread_text_key);
+}
+
 void pipeline_set_colorscheme(struct Pipeline* pipeline, const int **scheme) {
     for (int i = 0; i < 4; i++) {
         pipeline->foreground[i] = scheme[0][i];
@@ -270,3 +928,29 @@ void pipeline_color_background(struct Pipeline* pipeline, cairo_t *painter) {
 void set_color(cairo_t *painter, const int rgba[4]) {
     cairo_set_source_rgba(painter, rgba[0]/255.0, rgba[1]/255.0, rgba[2]/255.0, rgba[3]/255.0);
 }
+
+/* The calling thread's text state, created on first use. Default font maps are per thread, so nothing is shared. */
+struct ThreadText *thread_text(void) {
+    struct ThreadText *text = pthread_getspecific(thread_text_key);
+    if (text)
+        return text;
+
+    text = ecalloc(1, sizeof(*text));
+    text->context = pango_font_map_create_context(pango_cairo_font_map_get_default());
+    if (!text->context)
+        panic("font context");
+    text->layouts = layout_cache_create(text->context, layout_cache_size);
+    text->scratch = pango_layout_new(text->context);
+    pthread_setspecific(thread_text_key, text);
+
+    return text;
+}
+
+void thread_text_destroy(void *data) {
+    struct ThreadText *text = data;
+
+    g_object_unref(text->scratch);
+    layout_cache_destroy(text->layouts);
+    g_object_unref(text->context);
+    free(text);
+}
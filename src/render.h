@@ -1,6 +1,8 @@
 #ifndef RENDER_H_
 #define RENDER_H_
 
+#include "cache.h"
+#include "event.h"
 #include "util.h"
 #include "shm.h"
 #include "user.h"
@@ -8,23 +10,60 @@
 #include "pango/pango-types.h"
 #include <pango/pango.h>
 #include <cairo.h>
+#include <stdint.h>
 
+/* How long after input the bar skips coalescing, so the reaction to a click shows up immediately. */
+#define PIPELINE_INPUT_WINDOW 250
+
+/* Ends text that was cut short before shaping. */
+#define ELLIPSIS "\xe2\x80\xa6" /* U+2026 in UTF-8 */
+
+/* A loaded font, shared between pipelines through font_acquire. */
 struct Font {
+    char *name;
     PangoFontDescription *description;
     unsigned int height, approx_width;
+
+    PangoContext *context;
+    struct LayoutCache *layouts;
+
+    unsigned int references;
+    struct wl_list link;
+};
+
+/* A span of the bar and what is there, published by components as they render. */
+struct Region {
+    int start, end;
+    struct Hotspot *hotspot; /* Whose click callback handles it */
+    int location, index /* Meaning is up to the hotspot, the bar uses enum Clicked and a tag index */;
 };
 
 /* The render pipeline, also handles click events by keeping track of each components bounds'. */
 struct Pipeline {
     struct List *callbacks; /* struct PipelineCallbacks* */
     int current /* The current callback we are on */,
-        invalid;
+        invalid,
+        redraw /* Buffer contents are unusable, every component has to draw this frame */,
+        queued /* Waiting in pipeline_render_ready */;
 
     /* Colors */
     int background[4], foreground[4];
 
+    /* Borrowed from the shared font */
     PangoContext *context;
     struct Font *font;
+    struct LayoutCache *layouts;
+
+    /* Scheduling, invalidations are merged and rendered at most max_fps times a second. */
+    struct Events *events;
+    struct EventTimer *timer;
+    int scheduled;
+    uint64_t last_frame, boost_until;
+    unsigned long frames_requested, frames_rendered;
+
+    /* Sorted by x and rebuilt every frame, so a click is a binary search. */
+    struct Region *regions;
+    int regions_length, regions_capacity;
 
     struct Shm *shm;
     struct wl_surface *surface;
@@ -39,30 +78,65 @@ struct PipelineListener {
 struct PipelineCallback {
     const struct PipelineListener *listener;
     void *data;
+    int width /* Measured width of this callback */,
+        future /* Measured widths of every callback after this one */;
 };
 
 /* Basic helper component, can be used if the only thing to be displayed is text. */
 struct BasicComponent {
-    PangoLayout *layout;
+    PangoLayout *layout; /* Shared with the layout cache when text is set through basic_component_set_text */
+    const PangoFontDescription *description;
     int width, height,
         x, y /* box start coordinates */,
-        tx, ty /* text starts coordinates, tx is added to starting x coordinates. */;
+        tx, ty /* text starts coordinates, tx is added to starting x coordinates. */,
+        dirty /* Contents changed since the last time this was drawn */,
+        text_width /* Pixel width of the text, updated whenever the text is */;
+    struct Rect drawn; /* Where this was last drawn */
+
+    size_t max_chars; /* Characters past this are dropped and replaced by an ellipsis, 0 for no limit */
+    /* What the text was last set from, setting the same text again is skipped without shaping. */
+    char *text;
+    size_t text_length, text_capacity, text_max_chars;
+    char *truncated; /* The text cut at max_chars with the ellipsis, what's shaped when it's cut */
+    size_t truncated_capacity;
+    PangoLayout *ellipsized; /* Private layout of the text cut to fit, drawn instead when `ellipsize` is set */
+    int ellipsize, ellipsized_width;
 };
 
 struct BasicComponent *basic_component_create(PangoContext *context, PangoFontDescription *description);
 void basic_component_destroy(struct BasicComponent *component);
-int basic_component_is_clicked(struct BasicComponent *component, double x, double y);
-void basic_component_render(struct BasicComponent *component, struct Pipeline *pipeline,
+int basic_component_damage(struct BasicComponent *component, struct Pipeline *pipeline, int x, int y);
+int basic_component_fit(struct BasicComponent *component, int width);
+int basic_component_render(struct BasicComponent *component, struct Pipeline *pipeline,
         cairo_t *painter, int *x, int *y);
+void basic_component_set_max_chars(struct BasicComponent *component, struct LayoutCache *cache, size_t max_chars);
+int basic_component_set_text(struct BasicComponent *component, struct LayoutCache *cache, const char *text);
 int basic_component_text_width(struct BasicComponent *component);
+struct Font *font_acquire(const char *name);
+void font_preload(const char *name);
+void font_preload_stop(void);
+void font_release(struct Font *font);
 void pipeline_add(struct Pipeline *pipeline, const struct PipelineListener *listener, void *data);
-struct Pipeline *pipeline_create(void);
+void pipeline_boost(struct Pipeline *pipeline);
+void pipeline_blit(struct Pipeline *pipeline, cairo_t *painter, cairo_surface_t *image, int x, int y);
+void pipeline_blit_rect(struct Pipeline *pipeline, cairo_t *painter, cairo_surface_t *image,
+        const struct Rect *source, int x, int y);
+void pipeline_damage(struct Pipeline *pipeline, const struct Rect *rect);
+struct Pipeline *pipeline_create(struct Events *events);
 void pipeline_destroy(struct Pipeline *pipeline);
 int pipeline_get_future_widths(struct Pipeline *pipeline);
 void pipeline_hide(struct Pipeline *pipeline);
 void pipeline_invalidate(struct Pipeline *pipeline);
 int pipeline_is_visible(struct Pipeline *pipeline);
+const struct Region *pipeline_region_at(struct Pipeline *pipeline, double x);
+void pipeline_region_add(struct Pipeline *pipeline, struct Hotspot *hotspot, int start, int end, int location, int index);
+void pipeline_render_ready(void);
+int pipeline_render_offscreen(struct Pipeline *pipeline);
 void pipeline_show(struct Pipeline *pipeline, struct wl_output *output);
+void pipeline_show_layout(cairo_t *painter, PangoLayout *layout);
+void pipeline_show_offscreen(struct Pipeline *pipeline, int width, int height);
+void pipeline_workers_start(int threads);
+void pipeline_workers_stop(void);
 void pipeline_set_colorscheme(struct Pipeline* pipeline, const int **scheme);
 void pipeline_color_foreground(struct Pipeline* pipeline, cairo_t *painter);
 void pipeline_color_background(struct Pipeline* pipeline, cairo_t *painter);
@@ -1,16 +1,20 @@
 #include "shm.h"
+#include "log.h"
 #include "main.h"
+#include "util.h"
+#include <string.h>
 #include <wayland-client-protocol.h>
 
-#define BUFFERS 2
-
 static int allocate_shm(int size);
-static struct Buffer buffer_create(struct MemoryMapping *memmap, struct wl_shm_pool *shm,
-        int fd, int width, int height, int offset, enum wl_shm_format format);
+static void buffer_copy(struct Shm *shm, struct Buffer *dest, const struct Buffer *src, const struct Rect *rect);
+static struct Buffer *buffer_create(int width, int height, enum wl_shm_format format, int offscreen);
 static void buffer_destroy(struct Buffer *buf);
+static void buffer_painter_create(struct Buffer *buffer, int width, int height, int stride);
+static void buffer_release(void *data, struct wl_buffer *wl_buffer);
 static struct MemoryMapping memory_mapping_create(int fd, int pool_size);
 static void memory_mapping_destroy(struct MemoryMapping *map);
 
+static const struct wl_buffer_listener buffer_listener = { .release = buffer_release };
 
 int allocate_shm(int size) {
     char name[] = "wl_shm";
@@ -27,25 +31,67 @@ int allocate_shm(int size) {
     return fd;
 }
 
-static struct Buffer buffer_create(struct MemoryMapping *map, struct wl_shm_pool *shm,
-        int fd, int width, int height, int offset, enum wl_shm_format format) {
-    if (!map)
-        panic("map is null");
+/* Offscreen buffers are ordinary memory without a wl_buffer, for drawing without a compositor. */
+struct Buffer *buffer_create(int width, int height, enum wl_shm_format format, int offscreen) {
+    int stride = width * 4,
+        size   = height * stride;
+    struct Buffer *buffer = ecalloc(1, sizeof(*buffer));
+
+    if (offscreen) {
+        buffer->map = (struct MemoryMapping){ ecalloc(1, size), size };
+        buffer->buffer = NULL;
+    } else {
+        int fd = allocate_shm(size);
+        buffer->map = memory_mapping_create(fd, size);
+        struct wl_shm_pool *pool = wl_shm_create_pool(shm, fd, size);
+        buffer->buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride, format);
+        wl_buffer_add_listener(buffer->buffer, &buffer_listener, buffer);
+        wl_shm_pool_destroy(pool);
+        close(fd);
+    }
 
-    int stride    = width * 4,
-        pool_size = height * stride;
-    struct Buffer buffer;
+    buffer->buffer_ptr = buffer->map.ptr;
+    buffer->age = 0;
+    buffer->busy = 0;
+    buffer->idle = 0;
 
-    struct wl_buffer *wl_buffer = wl_shm_pool_create_buffer(shm, offset, width, height, stride, format);
-    buffer.buffer = wl_buffer;
-    buffer.buffer_ptr = map->ptr+offset;
+    buffer_painter_create(buffer, width, height, stride);
 
     return buffer;
 }
 
+void buffer_copy(struct Shm *shm, struct Buffer *dest, const struct Buffer *src, const struct Rect *rect) {
+    int offset = rect->y * shm->stride + rect->x * 4,
+        length = rect->width * 4;
+
+    for (int y = 0; y < rect->height; y++, offset += shm->stride)
+        memcpy(dest->buffer_ptr + offset, src->buffer_ptr + offset, length);
+}
+
 void buffer_destroy(struct Buffer *buffer) {
     if (!buffer) return;
-    wl_buffer_destroy(buffer->buffer);
+    cairo_destroy(buffer->painter);
+    cairo_surface_destroy(buffer->surface);
+    if (buffer->buffer) {
+        wl_buffer_destroy(buffer->buffer);
+        memory_mapping_destroy(&buffer->map);
+    } else
+        free(buffer->map.ptr);
+    free(buffer);
+}
+
+void buffer_painter_create(struct Buffer *buffer, int width, int height, int stride) {
+    buffer->surface = cairo_image_surface_create_for_data(buffer->buffer_ptr, CAIRO_FORMAT_ARGB32,
+            width, height, stride);
+    buffer->painter = cairo_create(buffer->surface);
+    if (cairo_status(buffer->painter) != CAIRO_STATUS_SUCCESS)
+        panic("cairo_create when creating buffer");
+    buffer->fresh = 1;
+}
+
+void buffer_release(void *data, struct wl_buffer *wl_buffer) {
+    struct Buffer *buffer = data;
+    buffer->busy = 0;
 }
 
 struct MemoryMapping memory_mapping_create(int fd, int pool_size) {
@@ -69,49 +115,208 @@ void memory_mapping_destroy(struct MemoryMapping *map) {
 }
 
 struct Shm *shm_create(int width, int height, enum wl_shm_format format) {
-    struct Shm *shared_mem = calloc(1, sizeof(*shared_mem));
-    int i, offset,
-        stride = width * 4,
-        size = stride * height,
-        total = size * BUFFERS;
-    int fd = allocate_shm(total);
-
-    struct MemoryMapping memory = memory_mapping_create(fd, total);
-    struct wl_shm_pool* pool = wl_shm_create_pool(shm, fd, total);
-    for (i = 0; i < BUFFERS; i++) {
-        offset = size*i;
-        shared_mem->buffers[i] = buffer_create(&memory, pool, fd, width, height, offset, format);
-    }
-    close(fd);
-    wl_shm_pool_destroy(pool);
+    struct Shm *shared_mem = ecalloc(1, sizeof(*shared_mem));
+
+    shared_mem->height = height;
+    shared_mem->width = width;
+    shared_mem->stride = width * 4;
+    shared_mem->format = format;
+
+    shared_mem->offscreen = 0;
+    shared_mem->transient = 0;
 
-    shared_mem->map = memory;
-    shared_mem->current = 0;
+    for (int i = 0; i < SHM_BUFFERS; i++)
+        shared_mem->buffers[shared_mem->length++] = buffer_create(width, height, format, 0);
+
+    shared_mem->current = NULL;
+    shared_mem->previous = NULL;
+    shared_mem->frame = 0;
+    shared_mem->stalls = 0;
+    shared_mem->overallocations = 0;
+
+    return shared_mem;
+}
+
+/* Buffers in plain memory that are never attached, frames drawn into them are only read back by the caller. */
+struct Shm *shm_create_offscreen(int width, int height) {
+    struct Shm *shared_mem = ecalloc(1, sizeof(*shared_mem));
 
     shared_mem->height = height;
     shared_mem->width = width;
-    shared_mem->stride = stride;
+    shared_mem->stride = width * 4;
+    shared_mem->format = WL_SHM_FORMAT_XRGB8888;
+    shared_mem->offscreen = 1;
+    shared_mem->transient = 0;
+
+    for (int i = 0; i < SHM_BUFFERS; i++)
+        shared_mem->buffers[shared_mem->length++] = buffer_create(width, height, shared_mem->format, 1);
+
+    shared_mem->current = NULL;
+    shared_mem->previous = NULL;
+    shared_mem->frame = 0;
+    shared_mem->stalls = 0;
+    shared_mem->overallocations = 0;
 
     return shared_mem;
 }
 
+void shm_damage(struct Shm *shm, int x, int y, int width, int height) {
+    if (!shm) return;
+
+    struct Damage *damage = shm_frame_damage(shm);
+    if (damage->full)
+        return;
+
+    /* Clip to the buffer so repairs never read or write out of bounds. */
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (x + width > shm->width) width = shm->width - x;
+    if (y + height > shm->height) height = shm->height - y;
+    if (width <= 0 || height <= 0)
+        return;
+
+    if (damage->length == SHM_DAMAGE_RECTS) {
+        damage->full = 1;
+        return;
+    }
+
+    damage->rects[damage->length++] = (struct Rect){ x, y, width, height };
+}
+
+struct Damage *shm_frame_damage(struct Shm *shm) {
+    return &shm->history[shm->frame % SHM_DAMAGE_HISTORY];
+}
+
 void shm_destroy(struct Shm *shm) {
     if (!shm) return;
 
-    memory_mapping_destroy(&shm->map);
-    for (int i = 0; i < BUFFERS; i++)
-        buffer_destroy(&shm->buffers[i]);
+    bar_log(LOG_INFO, "Shm %dx%d: %lu stalls, %lu over-allocations",
+            shm->width, shm->height, shm->stalls, shm->overallocations);
+
+    for (int i = 0; i < shm->length; i++)
+        buffer_destroy(shm->buffers[i]);
     free(shm);
 }
 
 uint8_t *shm_data(struct Shm *shm) {
-    return shm->buffers[shm->current].buffer_ptr;
+    return shm->current->buffer_ptr;
 }
 
 struct wl_buffer *shm_buffer(struct Shm *shm) {
-    return shm->buffers[shm->current].buffer;
+    return shm->current->buffer;
+}
+
+cairo_t *shm_painter(struct Shm *shm) {
+    return shm->current->painter;
 }
 
+/*
+ * Marks the current buffer as handed to the compositor and ages the others.
+ * Extra buffers that have gone unused for a while are freed here.
+ */
 void shm_flip(struct Shm *shm) {
-    shm->current = 1-shm->current;
+    struct Buffer *buffer;
+    for (int i = 0; i < shm->length; i++) {
+        buffer = shm->buffers[i];
+        if (buffer->age)
+            buffer->age++;
+        buffer->idle++;
+    }
+
+    shm->current->age = 1;
+    shm->current->idle = 0;
+    /* Nobody releases offscreen buffers, they are free again as soon as they are presented. */
+    shm->current->busy = !shm->offscreen;
+
+    shm->previous = shm->current;
+    shm->current = NULL;
+
+    for (int i = shm->length-1; i >= 0 && shm->length > SHM_BUFFERS; i--) {
+        buffer = shm->buffers[i];
+        if (buffer->busy || buffer->idle < SHM_IDLE_FRAMES)
+            continue;
+
+        buffer_destroy(buffer);
+        shm->buffers[i] = shm->buffers[--shm->length];
+    }
+
+    shm->frame++;
+    struct Damage *damage = shm_frame_damage(shm);
+    damage->length = 0;
+    damage->full = 0;
+}
+
+/*
+ * Picks the buffer to draw the next frame into, one the compositor is not reading from.
+ * Of the free buffers the one needing the least repair is preferred, if there are none
+ * another buffer is allocated, up to SHM_MAX_BUFFERS.
+ * Returns 0 if every buffer is busy, the frame should be retried later.
+ */
+int shm_next(struct Shm *shm) {
+    if (!shm) return 0;
+
+    struct Buffer *buffer, *best = NULL;
+    for (int i = 0; i < shm->length; i++) {
+        buffer = shm->buffers[i];
+        if (buffer->busy)
+            continue;
+
+        if (!best || (buffer->age && (!best->age || buffer->age < best->age)))
+            best = buffer;
+    }
+
+    if (!best) {
+        if (shm->length == SHM_MAX_BUFFERS) {
+            shm->stalls++;
+            return 0;
+        }
+
+        best = shm->buffers[shm->length++] = buffer_create(shm->width, shm->height, shm->format, shm->offscreen);
+        shm->overallocations++;
+    }
+
+    /* Done here rather than in shm_painter, which may run off the main thread. */
+    if (shm->transient) {
+        cairo_destroy(best->painter);
+        cairo_surface_destroy(best->surface);
+        buffer_painter_create(best, shm->width, shm->height, shm->stride);
+    }
+
+    shm->current = best;
+    return 1;
+}
+
+/*
+ * Bring the current buffer up to date with the last presented frame by copying over
+ * everything damaged since it was last drawn to.
+ * Returns 0 if that is not possible and the caller has to redraw everything.
+ */
+int shm_repair(struct Shm *shm) {
+    struct Buffer *buffer = shm->current,
+                  *latest = shm->previous;
+    const struct Damage *damage;
+    unsigned int i;
+    int j;
+
+    if (!latest || buffer->age == 0 || buffer->age > SHM_DAMAGE_HISTORY)
+        return 0;
+    if (buffer->age == 1)
+        return 1;
+
+    cairo_surface_flush(buffer->surface);
+    for (i = 1; i < buffer->age; i++) {
+        damage = &shm->history[(shm->frame - i) % SHM_DAMAGE_HISTORY];
+        if (damage->full) {
+            memcpy(buffer->buffer_ptr, latest->buffer_ptr, shm->stride * shm->height);
+            break;
+        }
+
+        for (j = 0; j < damage->length; j++)
+            buffer_copy(shm, buffer, latest, &damage->rects[j]);
+    }
+    cairo_surface_mark_dirty(buffer->surface);
+
+    /* Whether or not this frame gets presented, the contents now match the latest frame. */
+    buffer->age = 1;
+    return 1;
 }
@@ -1,6 +1,7 @@
 #ifndef SHM_H_
 #define SHM_H_
 
+#include <cairo.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
@@ -9,6 +10,25 @@
 #include <sys/stat.h>
 #include <wayland-client-protocol.h>
 
+/* Buffers kept around, more are only allocated while the compositor holds onto all of them. */
+#define SHM_BUFFERS 2
+#define SHM_MAX_BUFFERS 4
+/* Frames an extra buffer can go unused before it is freed again. */
+#define SHM_IDLE_FRAMES 120
+/* How many frames of damage are remembered for repairing older buffers. */
+#define SHM_DAMAGE_HISTORY 4
+/* Past this many rects in a frame the whole frame is considered damaged. */
+#define SHM_DAMAGE_RECTS 16
+
+struct Rect {
+    int x, y, width, height;
+};
+
+struct Damage {
+    struct Rect rects[SHM_DAMAGE_RECTS];
+    int length, full;
+};
+
 struct MemoryMapping {
     void *ptr;
     int size;
@@ -16,19 +36,45 @@ struct MemoryMapping {
 
 struct Buffer {
     struct wl_buffer *buffer;
+    struct MemoryMapping map;
     uint8_t *buffer_ptr;
+    /* Drawing state bound to this buffer for as long as it lives. */
+    cairo_surface_t *surface;
+    cairo_t *painter;
+    int fresh; /* The painter was created since the pipeline last picked this buffer */
+    unsigned int age, /* Frames since this buffer held the latest contents, 0 if it never has. */
+                 busy, /* Attached and not yet released by the compositor */
+                 idle; /* Frames since this buffer was last drawn to */
 };
 
 struct Shm {
-    int width, height, stride, current;
-    struct MemoryMapping map;
-    struct Buffer buffers[2];
+    int width, height, stride;
+    enum wl_shm_format format;
+    struct Buffer *buffers[SHM_MAX_BUFFERS];
+    int length;
+    struct Buffer *current /* Being drawn to, set by shm_next */,
+                  *previous /* Holds the latest presented frame */;
+
+    /* Ring of damage for the most recent frames, history[frame] is the one being drawn. */
+    struct Damage history[SHM_DAMAGE_HISTORY];
+    unsigned int frame;
+    int offscreen; /* Plain memory nothing is shared with the compositor, see shm_create_offscreen */
+    int transient; /* Recreate the cairo surface for every frame instead of keeping one per buffer, for comparison */
+
+    unsigned long stalls /* Frames skipped because every buffer was busy */,
+                  overallocations /* Buffers allocated past SHM_BUFFERS */;
 };
 
 struct Shm *shm_create(int width, int height, enum wl_shm_format format);
+struct Shm *shm_create_offscreen(int width, int height);
+void shm_damage(struct Shm *shm, int x, int y, int width, int height);
+struct Damage *shm_frame_damage(struct Shm *shm);
 void shm_destroy(struct Shm *shm);
+int shm_next(struct Shm *shm);
+int shm_repair(struct Shm *shm);
 uint8_t *shm_data(struct Shm *shm);
 struct wl_buffer *shm_buffer(struct Shm *shm);
+cairo_t *shm_painter(struct Shm *shm);
 void shm_flip(struct Shm *shm);
 
 
@@ -1,5 +1,6 @@
 #include "user.h"
 #include "util.h"
+#include <signal.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,6 +9,11 @@ void spawn(struct Monitor *monitor, const union Arg *arg) {
   if (fork() != 0)
     return;
 
+  /* The bar reads its signals from a signalfd, the child gets them delivered as usual. */
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigprocmask(SIG_SETMASK, &signals, NULL);
+
   char* const* argv = arg->v;
   setsid();
   execvp(argv[0], argv);
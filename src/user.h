@@ -31,6 +31,21 @@ enum PointerScroll {
     Scroll_Right,
 };
 
+enum StatusModule {
+    Module_Clock,   /* argument is a strftime format */
+    Module_Battery, /* argument is the power supply's name in /sys/class/power_supply */
+    Module_Cpu,     /* argument is a label put in front */
+    Module_Memory,  /* argument is a label put in front */
+    Module_Load,    /* argument is a label put in front */
+};
+
+struct StatusBlock {
+    enum StatusModule module;
+    unsigned int interval; /* Milliseconds between updates */
+    const char *argument; /* Put before the block's text, the strftime format for the clock */
+    const char *device; /* The power supply under /sys/class/power_supply for the battery */
+};
+
 union Arg {
     unsigned int ui;
     int i;
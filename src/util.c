@@ -5,6 +5,7 @@
 #include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 static void list_resize(struct List *list);
@@ -121,6 +122,31 @@ char *string_create(const char *fmt, ...) {
     return str;
 }
 
+/* Milliseconds on the monotonic clock. */
+uint64_t time_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/* Microseconds on the monotonic clock. */
+uint64_t time_us(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/* FNV-1a, cheap and good enough for the short strings we deal with. */
+uint32_t string_hash(const char *string, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)string[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
 char *to_delimiter(const char *string, unsigned long *start_end, char delimiter) {
     if (!string || !start_end)
         return NULL;
@@ -1,6 +1,7 @@
 #ifndef UTIL_H_
 #define UTIL_H_
 #include <stddef.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <wayland-util.h>
@@ -24,6 +25,9 @@ void list_elements_destroy(struct List *list, void (*destroy)(void *data));
 int list_find(struct List* list, const void *data);
 void *list_remove(struct List *list, unsigned int index);
 char *string_create(const char* fmt, ...);
+uint64_t time_ms(void);
+uint64_t time_us(void);
+uint32_t string_hash(const char *string, size_t length);
 char *to_delimiter(const char* string, ulong *start_end, char delimiter);
 
 #endif // UTIL_H_
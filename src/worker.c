@@ -0,0 +1,117 @@
+#include "worker.h"
+#include "main.h"
+#include "util.h"
+#include <stdlib.h>
+
+static void worker_pool_drain(struct WorkerPool *pool);
+static void *worker_thread(void *data);
+
+struct WorkerPool *worker_pool_create(int threads) {
+    if (threads <= 0)
+        return NULL;
+
+    struct WorkerPool *pool = ecalloc(1, sizeof(*pool));
+    pool->threads = ecalloc(threads, sizeof(*pool->threads));
+    pool->jobs = NULL;
+    pool->jobs_length = 0;
+    pool->next = 0;
+    pool->remaining = 0;
+    pool->generation = 0;
+    pool->stopping = 0;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (pool->length = 0; pool->length < threads; pool->length++)
+        if (pthread_create(&pool->threads[pool->length], NULL, worker_thread, pool) != 0)
+            panic("pthread_create");
+
+    return pool;
+}
+
+void worker_pool_destroy(struct WorkerPool *pool) {
+    if (!pool)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->length; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->work);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+}
+
+/* Takes jobs from the current batch until there are none left. Called with the lock held. */
+void worker_pool_drain(struct WorkerPool *pool) {
+    void *data;
+    while (pool->next < pool->jobs_length) {
+        data = pool->jobs[pool->next++];
+
+        pthread_mutex_unlock(&pool->lock);
+        pool->job(data);
+        pthread_mutex_lock(&pool->lock);
+
+        if (--pool->remaining == 0)
+            pthread_cond_broadcast(&pool->done);
+    }
+}
+
+/*
+ * Runs job on every element of jobs, spread over the pool and the calling thread,
+ * and returns once all of them are finished. Without a pool they just run in order.
+ */
+void worker_pool_run(struct WorkerPool *pool, void (*job)(void *data), void **jobs, int length) {
+    if (length <= 0)
+        return;
+
+    if (!pool || length == 1) {
+        for (int i = 0; i < length; i++)
+            job(jobs[i]);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->job = job;
+    pool->jobs = jobs;
+    pool->jobs_length = length;
+    pool->next = 0;
+    pool->remaining = length;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->work);
+
+    worker_pool_drain(pool);
+    while (pool->remaining > 0)
+        pthread_cond_wait(&pool->done, &pool->lock);
+
+    pool->jobs = NULL;
+    pool->jobs_length = 0;
+    pool->next = 0;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void *worker_thread(void *data) {
+    struct WorkerPool *pool = data;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1) {
+        while (!pool->stopping && pool->generation == seen)
+            pthread_cond_wait(&pool->work, &pool->lock);
+        if (pool->stopping)
+            break;
+
+        seen = pool->generation;
+        worker_pool_drain(pool);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
@@ -0,0 +1,26 @@
+#ifndef WORKER_H_
+#define WORKER_H_
+
+#include <pthread.h>
+
+/* Fixed set of threads running batches of independent jobs, the calling thread joins in. */
+struct WorkerPool {
+    pthread_t *threads;
+    int length;
+
+    pthread_mutex_t lock;
+    pthread_cond_t work, done;
+
+    /* The current batch */
+    void (*job)(void *data);
+    void **jobs;
+    int jobs_length, next, remaining;
+    unsigned long generation;
+    int stopping;
+};
+
+struct WorkerPool *worker_pool_create(int threads);
+void worker_pool_destroy(struct WorkerPool *pool);
+void worker_pool_run(struct WorkerPool *pool, void (*job)(void *data), void **jobs, int length);
+
+#endif // WORKER_H_